@@ -0,0 +1,349 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Owning and offset pointers against std::unique_ptr and boost::interprocess::offset_ptr: creation and destruction,
+// moves, dereferencing in random order and traversal of a list (linked in random order), per operation, plus the
+// memory footprint per node. On Linux, cache misses and branch mispredictions are counted as well (perf_event_open,
+// shown as - if not permitted, see /proc/sys/kernel/perf_event_paranoid).
+//
+// clang++ -std=c++17 -O3 -march=native -I../include pointers.cpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sax/iostream.hpp>
+#include <vector>
+
+#if defined( __linux__ )
+#    include <linux/perf_event.h>
+#    include <malloc.h>
+#    include <sys/ioctl.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#endif
+
+#include <boost/interprocess/offset_ptr.hpp>
+
+#include <offset_ptr.hpp>
+#include <stack_arena.hpp>
+
+// Hardware counters.
+
+#if defined( __linux__ )
+
+class counter {
+
+    public:
+    explicit counter ( std::uint64_t config_ ) noexcept {
+        perf_event_attr attr = { };
+        attr.type            = PERF_TYPE_HARDWARE;
+        attr.size            = sizeof ( attr );
+        attr.config          = config_;
+        attr.disabled        = 1;
+        attr.exclude_kernel  = 1;
+        attr.exclude_hv      = 1;
+        m_fd                 = static_cast<int> ( syscall ( SYS_perf_event_open, &attr, 0, -1, -1, 0 ) );
+    }
+
+    counter ( counter const & ) = delete;
+    counter & operator= ( counter const & ) = delete;
+
+    ~counter ( ) noexcept {
+        if ( m_fd >= 0 )
+            close ( m_fd );
+    }
+
+    void start ( ) noexcept {
+        if ( m_fd >= 0 ) {
+            ioctl ( m_fd, PERF_EVENT_IOC_RESET, 0 );
+            ioctl ( m_fd, PERF_EVENT_IOC_ENABLE, 0 );
+        }
+    }
+
+    // The count since start, or -1 if not available.
+    [[nodiscard]] double stop ( ) noexcept {
+        std::uint64_t count = 0;
+        if ( m_fd < 0 )
+            return -1.0;
+        ioctl ( m_fd, PERF_EVENT_IOC_DISABLE, 0 );
+        return read ( m_fd, &count, sizeof ( count ) ) == sizeof ( count ) ? static_cast<double> ( count ) : -1.0;
+    }
+
+    private:
+    int m_fd;
+};
+
+// The bytes malloc takes for p_, including its header.
+[[nodiscard]] std::size_t allocated ( void * p_ ) noexcept { return malloc_usable_size ( p_ ) + sizeof ( std::size_t ); }
+
+#else
+
+class counter {
+
+    public:
+    explicit counter ( std::uint64_t ) noexcept {}
+    void start ( ) noexcept {}
+    [[nodiscard]] double stop ( ) noexcept { return -1.0; }
+};
+
+#    define PERF_COUNT_HW_CACHE_MISSES 0
+#    define PERF_COUNT_HW_BRANCH_MISSES 0
+
+// Without a way to ask, assume 16-byte granularity and an 8-byte header.
+template<typename T>
+[[nodiscard]] std::size_t allocated ( T * ) noexcept {
+    return ( sizeof ( T ) + sizeof ( std::size_t ) + 15 ) & ~std::size_t{ 15 };
+}
+
+#endif
+
+// Nodes of 4 bytes of payload and a link, the value of the pointee is summed by the dereferencing benchmarks. A kind
+// defines the node, the pointer, the scope that has to exist while nodes exist (the pool, or the stack storage), how
+// to make and dispose of a node and how many bytes one takes.
+
+constexpr std::size_t nodes  = 16'384; // Addressable by all the offset pointers.
+constexpr std::size_t rounds = 256;
+
+struct std_unique_ptr_kind {
+    static constexpr char const * name = "std::unique_ptr";
+    static constexpr bool owning       = true;
+    struct node {
+        std::uint32_t value;
+        std::unique_ptr<node> next;
+    };
+    using pointer = std::unique_ptr<node>;
+    struct scope {};
+    [[nodiscard]] static pointer make ( scope &, std::uint32_t v_ ) { return pointer ( new node{ v_, nullptr } ); }
+    static void dispose ( scope &, pointer & p_ ) noexcept { p_.reset ( ); }
+    [[nodiscard]] static node * get ( pointer const & p_ ) noexcept { return p_.get ( ); }
+    [[nodiscard]] static std::size_t footprint ( pointer const & p_ ) noexcept { return allocated ( p_.get ( ) ); }
+};
+
+struct unique_ptr_kind {
+    static constexpr char const * name = "unique_ptr";
+    static constexpr bool owning       = true;
+    struct node {
+        std::uint32_t value;
+        unique_ptr<node> next;
+    };
+    using pointer = unique_ptr<node>;
+    struct scope {};
+    [[nodiscard]] static pointer make ( scope &, std::uint32_t v_ ) { return pointer ( new node{ v_, pointer ( ) } ); }
+    static void dispose ( scope &, pointer & p_ ) noexcept { p_.reset ( ); }
+    [[nodiscard]] static node * get ( pointer const & p_ ) noexcept { return p_.get ( ); }
+    [[nodiscard]] static std::size_t footprint ( pointer const & p_ ) noexcept { return allocated ( p_.get ( ) ); }
+};
+
+struct heap_offset_ptr_kind {
+    static constexpr char const * name = "heap_offset_ptr (offset_pool)";
+    static constexpr bool owning       = true;
+    struct node {
+        std::uint32_t value;
+        sax::heap_offset_ptr<node> next;
+    };
+    using pointer = sax::heap_offset_ptr<node>;
+    using scope   = sax::offset_pool<node>;
+    [[nodiscard]] static pointer make ( scope &, std::uint32_t v_ ) {
+        pointer p = sax::make_heap_offset<node> ( );
+        p->value  = v_;
+        return p;
+    }
+    static void dispose ( scope &, pointer & p_ ) noexcept { p_.reset ( ); }
+    [[nodiscard]] static node * get ( pointer const & p_ ) noexcept { return p_.get ( ); }
+    [[nodiscard]] static std::size_t footprint ( pointer const & ) noexcept { return sizeof ( node ); }
+};
+
+struct stack_offset_ptr_kind {
+    static constexpr char const * name = "stack_offset_ptr";
+    static constexpr bool owning       = false;
+    struct node {
+        std::uint32_t value;
+        sax::stack_offset_ptr<node> next;
+    };
+    using pointer = sax::stack_offset_ptr<node>;
+    // The nodes live in the frame of the benchmark.
+    using scope = sax::stack_arena<node, nodes>;
+    [[nodiscard]] static pointer make ( scope & s_, std::uint32_t v_ ) {
+        pointer p        = s_.construct ( );
+        p.get ( )->value = v_;
+        return p;
+    }
+    static void dispose ( scope & s_, pointer & p_ ) noexcept {
+        p_ = nullptr;
+        s_.clear ( );
+    }
+    [[nodiscard]] static node * get ( pointer const & p_ ) noexcept { return p_.get ( ); }
+    [[nodiscard]] static std::size_t footprint ( pointer const & ) noexcept { return sizeof ( node ); }
+};
+
+struct boost_offset_ptr_kind {
+    static constexpr char const * name = "boost::interprocess::offset_ptr";
+    static constexpr bool owning       = false;
+    struct node {
+        std::uint32_t value;
+        boost::interprocess::offset_ptr<node> next;
+    };
+    using pointer = boost::interprocess::offset_ptr<node>;
+    struct scope {};
+    [[nodiscard]] static pointer make ( scope &, std::uint32_t v_ ) { return pointer ( new node{ v_, nullptr } ); }
+    static void dispose ( scope &, pointer & p_ ) noexcept {
+        delete p_.get ( );
+        p_ = nullptr;
+    }
+    [[nodiscard]] static node * get ( pointer const & p_ ) noexcept { return p_.get ( ); }
+    [[nodiscard]] static std::size_t footprint ( pointer const & p_ ) noexcept { return allocated ( p_.get ( ) ); }
+};
+
+// Measurement.
+
+struct result {
+    double ns, cache_misses, branch_misses;
+};
+
+template<typename Function>
+[[nodiscard]] result measure ( std::size_t operations_, Function f_ ) {
+    counter cache ( PERF_COUNT_HW_CACHE_MISSES ), branch ( PERF_COUNT_HW_BRANCH_MISSES );
+    cache.start ( );
+    branch.start ( );
+    auto const start = std::chrono::steady_clock::now ( );
+    f_ ( );
+    double const ns = std::chrono::duration<double, std::nano> ( std::chrono::steady_clock::now ( ) - start ).count ( );
+    double const c = cache.stop ( ), b = branch.stop ( );
+    double const n = static_cast<double> ( operations_ );
+    return { ns / n, c < 0.0 ? c : c / n, b < 0.0 ? b : b / n };
+}
+
+void print ( char const * kind_, char const * benchmark_, result const & r_ ) {
+    std::cout << std::setw ( 32 ) << kind_ << std::setw ( 16 ) << benchmark_ << std::fixed << std::setprecision ( 2 )
+              << std::setw ( 10 ) << r_.ns << " ns/op";
+    for ( double c : { r_.cache_misses, r_.branch_misses } ) {
+        if ( c < 0.0 )
+            std::cout << std::setw ( 12 ) << '-';
+        else
+            std::cout << std::setw ( 12 ) << c;
+    }
+    std::cout << nl;
+}
+
+std::uint64_t sink = 0; // Keeps the loads alive.
+
+template<typename Kind>
+void run ( std::vector<std::uint32_t> const & order_ ) {
+    using node    = typename Kind::node;
+    using pointer = typename Kind::pointer;
+    typename Kind::scope scope;
+    std::vector<pointer> p;
+    p.reserve ( nodes );
+    auto make = [ & ] {
+        for ( std::uint32_t i = 0; i < nodes; ++i )
+            p.push_back ( Kind::make ( scope, i ) );
+    };
+    auto dispose = [ & ] {
+        for ( pointer & q : p )
+            Kind::dispose ( scope, q );
+        p.clear ( );
+    };
+
+    print ( Kind::name, "create/destroy", measure ( rounds * nodes, [ & ] {
+                for ( std::size_t r = 0; r < rounds; ++r ) {
+                    make ( );
+                    dispose ( );
+                }
+            } ) );
+
+    make ( );
+    print ( Kind::name, "move", measure ( rounds * nodes, [ & ] {
+                for ( std::size_t r = 0; r < rounds; ++r ) {
+                    pointer first = std::move ( p.front ( ) );
+                    for ( std::size_t i = 1; i < nodes; ++i )
+                        p[ i - 1 ] = std::move ( p[ i ] );
+                    p.back ( ) = std::move ( first );
+                }
+            } ) );
+
+    print ( Kind::name, "deref", measure ( rounds * nodes, [ & ] {
+                std::uint64_t sum = 0;
+                for ( std::size_t r = 0; r < rounds; ++r )
+                    for ( std::uint32_t i : order_ )
+                        sum += p[ i ]->value;
+                sink += sum;
+            } ) );
+
+    // Link the nodes in the order of order_, so that each hop lands on an unrelated address.
+    std::vector<node *> raw ( nodes );
+    for ( std::size_t i = 0; i < nodes; ++i )
+        raw[ i ] = Kind::get ( p[ i ] );
+    std::size_t const footprint = Kind::footprint ( p.front ( ) );
+    for ( std::size_t i = 0; i + 1 < nodes; ++i )
+        raw[ order_[ i ] ]->next = std::move ( p[ order_[ i + 1 ] ] );
+    pointer head = std::move ( p[ order_.front ( ) ] );
+    print ( Kind::name, "traversal", measure ( rounds * nodes, [ & ] {
+                std::uint64_t sum = 0;
+                for ( std::size_t r = 0; r < rounds; ++r )
+                    for ( node * n = Kind::get ( head ); n; n = Kind::get ( n->next ) )
+                        sum += n->value;
+                sink += sum;
+            } ) );
+    // Unlink, iteratively (a recursive destruction of the list could overflow the stack).
+    p.clear ( );
+    for ( node * n : raw )
+        p.push_back ( std::move ( n->next ) );
+    p.push_back ( std::move ( head ) );
+    if constexpr ( Kind::owning ) {
+        p.clear ( );
+    }
+    else {
+        for ( pointer & q : p )
+            if ( Kind::get ( q ) )
+                Kind::dispose ( scope, q );
+        p.clear ( );
+    }
+
+    std::cout << std::setw ( 32 ) << Kind::name << std::setw ( 16 ) << "footprint" << std::setw ( 10 ) << footprint
+              << " bytes/node (pointer " << sizeof ( pointer ) << ", node " << sizeof ( node ) << ')' << nl << nl;
+}
+
+int main ( ) {
+
+    std::vector<std::uint32_t> order ( nodes );
+    std::iota ( std::begin ( order ), std::end ( order ), std::uint32_t{ 0 } );
+    std::shuffle ( std::begin ( order ), std::end ( order ), std::mt19937{ 42 } );
+
+    std::cout << std::setw ( 32 ) << "pointer" << std::setw ( 16 ) << "benchmark" << std::setw ( 16 ) << "time"
+              << std::setw ( 12 ) << "cache-miss" << std::setw ( 12 ) << "branch-miss" << nl << nl;
+
+    run<std_unique_ptr_kind> ( order );
+    run<unique_ptr_kind> ( order );
+    run<heap_offset_ptr_kind> ( order );
+    run<stack_offset_ptr_kind> ( order );
+    run<boost_offset_ptr_kind> ( order );
+
+    return sink == 1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Batched, prefetching lookups (sax::descend) against one lookup at a time, on a binary search tree that is much
+// larger than the last level cache, nodes are allocated in random key order, so every hop is a likely cache miss.
+// The same, on a tree of offset_ptr links in an offset_region, which holds at most 32'767 nodes (a cache line each,
+// in random key order), that tree fits in a large last level cache, so it mostly shows the cost of the decode.
+//
+// clang++ -std=c++17 -O3 -march=native -I../include prefetch.cpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <sax/iostream.hpp>
+#include <vector>
+
+#include <offset_ptr.hpp>
+#include <offset_ptr_traversal.hpp>
+#include <offset_region.hpp>
+
+struct node {
+    std::uint64_t key;
+    unique_ptr<node> left, right;
+
+    explicit node ( std::uint64_t key_ ) noexcept : key ( key_ ) {}
+};
+
+struct alignas( 64 ) offset_node {
+    using link = sax::detail::offset_ptr<offset_node, sax::detail::heap_offset_ptr_pointer, sax::no_delete>;
+
+    std::uint64_t key;
+    link left, right;
+
+    explicit offset_node ( std::uint64_t key_ ) noexcept : key ( key_ ) {}
+};
+
+// Null links are nullptr, for both trees, which ends the descent.
+template<typename Node>
+[[nodiscard]] Node * step ( Node * n_, std::uint64_t const & key_ ) noexcept {
+    if ( key_ == n_->key )
+        return nullptr;
+    return key_ < n_->key ? n_->left.get ( ) : n_->right.get ( );
+}
+
+template<typename Function>
+[[nodiscard]] double time_ms ( Function f_ ) {
+    auto const start = std::chrono::steady_clock::now ( );
+    f_ ( );
+    return std::chrono::duration<double, std::milli> ( std::chrono::steady_clock::now ( ) - start ).count ( );
+}
+
+[[nodiscard]] std::vector<std::uint64_t> shuffled ( std::size_t n_, std::mt19937_64 & rng_ ) {
+    std::vector<std::uint64_t> keys ( n_ );
+    std::iota ( std::begin ( keys ), std::end ( keys ), std::uint64_t{ 0 } );
+    std::shuffle ( std::begin ( keys ), std::end ( keys ), rng_ );
+    return keys;
+}
+
+// Insert the keys, in order, below root_, make_ ( key ) returns the new node.
+template<typename Link, typename Make>
+void insert ( Link & root_, std::vector<std::uint64_t> const & keys_, Make make_ ) {
+    for ( std::uint64_t k : keys_ ) {
+        Link * link = std::addressof ( root_ );
+        while ( *link )
+            link = k < ( *link )->key ? std::addressof ( ( *link )->left ) : std::addressof ( ( *link )->right );
+        *link = make_ ( k );
+    }
+}
+
+template<typename Node>
+[[nodiscard]] std::uint64_t run ( char const * tree_, Node * root_, std::size_t nodes_, std::mt19937_64 & rng_ ) {
+
+    constexpr std::size_t lookups = std::size_t{ 1 } << 21;
+
+    std::vector<std::uint64_t> queries ( lookups );
+    std::uniform_int_distribution<std::uint64_t> dis ( 0, nodes_ - 1 );
+    for ( std::uint64_t & q : queries )
+        q = dis ( rng_ );
+
+    std::vector<Node *> result ( lookups );
+    std::uint64_t check = 0;
+
+    std::cout << tree_ << ", " << nodes_ << " nodes" << nl;
+
+    auto report = [ & ] ( char const * name_, double ms_ ) {
+        check += std::accumulate ( std::begin ( result ), std::end ( result ), std::uint64_t{ 0 },
+                                   [] ( std::uint64_t a, Node const * n ) { return a + n->key; } );
+        std::cout << std::setw ( 24 ) << name_ << std::setw ( 10 ) << std::fixed << std::setprecision ( 1 )
+                  << ( ms_ * 1'000'000.0 / lookups ) << " ns/lookup" << nl;
+    };
+
+    report ( "one at a time", time_ms ( [ & ] {
+                 for ( std::size_t i = 0; i < lookups; ++i )
+                     result[ i ] = sax::descend ( root_, queries[ i ], step<Node> );
+             } ) );
+    report ( "interleaved, group 4", time_ms ( [ & ] {
+                 sax::descend<4> ( root_, queries.data ( ), lookups, step<Node>, result.data ( ) );
+             } ) );
+    report ( "interleaved, group 8", time_ms ( [ & ] {
+                 sax::descend<8> ( root_, queries.data ( ), lookups, step<Node>, result.data ( ) );
+             } ) );
+    report ( "interleaved, group 16", time_ms ( [ & ] {
+                 sax::descend<16> ( root_, queries.data ( ), lookups, step<Node>, result.data ( ) );
+             } ) );
+
+    return check;
+}
+
+int main ( ) {
+
+    std::mt19937_64 rng ( 0x5EED );
+    std::uint64_t check = 0;
+
+    {
+        constexpr std::size_t nodes = std::size_t{ 1 } << 22;
+        unique_ptr<node> root;
+        insert ( root, shuffled ( nodes, rng ), [] ( std::uint64_t k_ ) { return make_unique<node> ( k_ ); } );
+        check += run ( "unique_ptr", root.get ( ), nodes, rng );
+    }
+    {
+        sax::offset_region<offset_node> region;
+        constexpr std::size_t nodes = sax::offset_region<offset_node>::capacity ( );
+        offset_node::link root;
+        insert ( root, shuffled ( nodes, rng ), [ &region ] ( std::uint64_t k_ ) { return region.construct ( k_ ); } );
+        check += run ( "offset_ptr (offset_region)", root.get ( ), nodes, rng );
+    }
+
+    std::cout << "checksum " << check << nl;
+
+    return EXIT_SUCCESS;
+}
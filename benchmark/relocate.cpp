@@ -0,0 +1,80 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+// Cost of growing a vector of owning pointers, std::vector move constructs and destroys every element on
+// reallocation, sax::relocating_vector memcpy's (or realloc's) trivially relocatable elements.
+//
+// clang++ -std=c++17 -O3 -march=native -I../include relocate.cpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <chrono>
+#include <memory>
+#include <sax/iostream.hpp>
+#include <vector>
+
+#include <offset_ptr.hpp>
+#include <relocating_vector.hpp>
+
+template<typename Function>
+[[nodiscard]] double time_ms ( Function f_ ) {
+    auto const start = std::chrono::steady_clock::now ( );
+    f_ ( );
+    return std::chrono::duration<double, std::milli> ( std::chrono::steady_clock::now ( ) - start ).count ( );
+}
+
+constexpr std::size_t elements = std::size_t{ 1 } << 22;
+
+// Fill from empty (all intermediate regrowths), then one more regrowth of the full vector.
+template<typename Vector, typename Make>
+void run ( char const * name_, Make make_ ) {
+    Vector v;
+    double const fill = time_ms ( [ & ] {
+        for ( std::size_t i = 0; i < elements; ++i )
+            v.push_back ( make_ ( ) );
+    } );
+    double const regrow = time_ms ( [ & ] { v.reserve ( 2 * v.capacity ( ) ); } );
+    std::cout << std::setw ( 48 ) << name_ << std::fixed << std::setprecision ( 2 ) << std::setw ( 10 ) << fill
+              << " ms fill" << std::setw ( 10 ) << regrow << " ms regrow" << nl;
+}
+
+int main ( ) {
+
+    static_assert ( sax::is_trivially_relocatable_v<unique_ptr<int>> );
+    static_assert ( sax::is_trivially_relocatable_v<sax::heap_offset_ptr<int>> );
+
+    // Null pointers, so that only the container is measured, not the allocator.
+    run<std::vector<std::unique_ptr<int>>> ( "std::vector<std::unique_ptr>", [] { return std::unique_ptr<int> ( ); } );
+    run<std::vector<unique_ptr<int>>> ( "std::vector<unique_ptr>", [] { return unique_ptr<int> ( ); } );
+    run<sax::relocating_vector<std::unique_ptr<int>>> ( "sax::relocating_vector<std::unique_ptr>",
+                                                        [] { return std::unique_ptr<int> ( ); } );
+    run<sax::relocating_vector<unique_ptr<int>>> ( "sax::relocating_vector<unique_ptr>", [] { return unique_ptr<int> ( ); } );
+    run<std::vector<sax::heap_offset_ptr<int>>> ( "std::vector<heap_offset_ptr>", [] { return sax::heap_offset_ptr<int> ( ); } );
+    run<sax::relocating_vector<sax::heap_offset_ptr<int>>> ( "sax::relocating_vector<heap_offset_ptr>",
+                                                             [] { return sax::heap_offset_ptr<int> ( ); } );
+
+    return EXIT_SUCCESS;
+}
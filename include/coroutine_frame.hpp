@@ -0,0 +1,210 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+// Coroutine frames from a per request arena. The promise type of a coroutine derives from sax::frame_allocated, a
+// sax::frame_arena is installed on the thread for the duration of a request, the frames of the coroutines created on
+// that thread are then carved out of the arena, contiguous, and recycled through free lists per size class. The
+// objects in the frames can be addressed by 2-byte sax::frame_offset_ptr's. Without an installed arena (or for frames
+// that do not fit) the frames come from operator new. Every frame is preceded by a granule that records where it came
+// from, so it goes back there, whatever arena is installed when it is destroyed, and on whichever thread (frames
+// destroyed on another thread, e.g. by an executor, go onto a lock-free list per size class, that the arena takes
+// over when its own list runs dry). Requires C++20 coroutines, the header is empty otherwise.
+
+#if defined( __cpp_impl_coroutine ) and __has_include( <coroutine> )
+
+#    include <cstddef>
+#    include <cstdint>
+#    include <cstring>
+
+#    include <array>
+#    include <atomic>
+#    include <new>
+#    include <stdexcept>
+#    include <utility>
+
+#    include "offset_ptr.hpp"
+
+namespace sax {
+
+class frame_arena {
+
+    public:
+    using size_type   = std::size_t;
+    using offset_type = std::uint16_t;
+
+    // Frames are allocated in granules, offsets are in granules, granule 0 is null.
+    static constexpr size_type granule   = alignof ( std::max_align_t );
+    static constexpr size_type granules  = size_type{ 1 } << ( sizeof ( offset_type ) * 8 );
+    static constexpr size_type bytes     = granules * granule;
+    static constexpr size_type max_frame = 4'096; // Larger frames (including the header) come from operator new.
+    static constexpr size_type classes   = max_frame / granule;
+
+    explicit frame_arena ( placement const & where_ = { } ) :
+        m_map ( bytes, where_ ), m_data ( static_cast<char *> ( m_map.data ( ) ) ),
+        m_previous ( std::exchange ( current, this ) ) {}
+
+    frame_arena ( frame_arena const & ) = delete;
+    frame_arena & operator= ( frame_arena const & ) = delete;
+
+    // All frames allocated from the arena must have been destroyed, on any thread.
+    ~frame_arena ( ) noexcept { current = m_previous; }
+
+    // The arena installed on this thread, if any.
+    [[nodiscard]] static frame_arena * installed ( ) noexcept { return current; }
+
+    [[nodiscard]] static void * allocate ( size_type size_ ) {
+        size_type const size = size_ + granule;
+        frame_arena * arena  = current;
+        void * p             = arena ? arena->allocate_frame ( size ) : nullptr;
+        if ( not p ) {
+            p     = ::operator new ( size );
+            arena = nullptr;
+        }
+        std::memcpy ( p, &arena, sizeof ( arena ) );
+        return static_cast<char *> ( p ) + granule;
+    }
+
+    static void deallocate ( void * p_, size_type size_ ) noexcept {
+        void * const p = static_cast<char *> ( p_ ) - granule;
+        frame_arena * arena;
+        std::memcpy ( &arena, p, sizeof ( arena ) );
+        if ( not arena )
+            ::operator delete ( p, size_ + granule );
+        else if ( arena == current )
+            arena->deallocate_frame ( p, size_ + granule );
+        else
+            arena->deallocate_remote ( p, size_ + granule );
+    }
+
+    [[nodiscard]] bool contains ( void const * p_ ) const noexcept {
+        return m_data < p_ and p_ < m_data + m_top * granule;
+    }
+
+    [[nodiscard]] char * data ( ) const noexcept { return m_data; }
+    // The granules handed out so far (including the ones on the free lists).
+    [[nodiscard]] size_type top ( ) const noexcept { return m_top; }
+
+    [[nodiscard]] placement_stats const & stats ( ) const noexcept { return m_map.stats ( ); }
+
+    [[nodiscard]] offset_type offset_of ( void const * p_ ) const noexcept {
+        return static_cast<offset_type> ( ( static_cast<char const *> ( p_ ) - m_data ) / granule );
+    }
+    [[nodiscard]] void * address_of ( offset_type o_ ) const noexcept { return m_data + o_ * granule; }
+
+    private:
+    detail::mapping m_map;
+    char * m_data;
+    frame_arena * m_previous;
+    size_type m_top = 1;
+    std::array<offset_type, classes> m_free = { }; // The heads of the free lists, linked through the free frames.
+    std::array<std::atomic<offset_type>, classes> m_remote = { }; // The same, for the frames freed elsewhere.
+
+    inline static thread_local frame_arena * current = nullptr;
+
+    [[nodiscard]] static constexpr size_type size_class ( size_type size_ ) noexcept { return ( size_ + granule - 1 ) / granule - 1; }
+
+    [[nodiscard]] void * allocate_frame ( size_type size_ ) noexcept {
+        if ( not size_ or size_ > max_frame )
+            return nullptr;
+        size_type const c = size_class ( size_ );
+        if ( not m_free[ c ] and m_remote[ c ].load ( std::memory_order_relaxed ) )
+            m_free[ c ] = m_remote[ c ].exchange ( 0, std::memory_order_acquire );
+        if ( offset_type const head = m_free[ c ] ) {
+            void * p = address_of ( head );
+            std::memcpy ( &m_free[ c ], p, sizeof ( offset_type ) );
+            return p;
+        }
+        if ( m_top + c + 1 > granules )
+            return nullptr;
+        void * p = address_of ( static_cast<offset_type> ( m_top ) );
+        m_top += c + 1;
+        return p;
+    }
+
+    void deallocate_frame ( void * p_, size_type size_ ) noexcept {
+        size_type const c = size_class ( size_ );
+        std::memcpy ( p_, &m_free[ c ], sizeof ( offset_type ) );
+        m_free[ c ] = offset_of ( p_ );
+    }
+
+    // From any thread, the list is only ever taken as a whole (in allocate_frame), so the push is free of ABA.
+    void deallocate_remote ( void * p_, size_type size_ ) noexcept {
+        std::atomic<offset_type> & head = m_remote[ size_class ( size_ ) ];
+        offset_type const o             = offset_of ( p_ );
+        offset_type h                   = head.load ( std::memory_order_relaxed );
+        do
+            std::memcpy ( p_, &h, sizeof ( offset_type ) );
+        while ( not head.compare_exchange_weak ( h, o, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+};
+
+// The mixin for promise types, struct promise_type : sax::frame_allocated { ... }.
+struct frame_allocated {
+    [[nodiscard]] static void * operator new ( std::size_t size_ ) { return frame_arena::allocate ( size_ ); }
+    static void operator delete ( void * p_, std::size_t size_ ) noexcept { frame_arena::deallocate ( p_, size_ ); }
+};
+
+// A non-owning pointer to an object in a frame of the installed arena, the object must be aligned to a granule (as
+// frames, and so promises, are).
+template<typename T>
+class frame_offset_ptr {
+
+    public:
+    using value_type  = T;
+    using pointer     = value_type *;
+    using reference   = value_type &;
+    using offset_type = frame_arena::offset_type;
+
+    frame_offset_ptr ( ) noexcept = default;
+    frame_offset_ptr ( std::nullptr_t ) noexcept {}
+
+    explicit frame_offset_ptr ( pointer p_ ) {
+        if ( not p_ )
+            return;
+        frame_arena const * arena = frame_arena::installed ( );
+        if ( not arena or not arena->contains ( p_ ) or reinterpret_cast<std::uintptr_t> ( p_ ) % frame_arena::granule )
+            throw std::runtime_error ( "frame_offset_ptr: pointer not addressable from the installed frame_arena" );
+        m_offset = arena->offset_of ( p_ );
+    }
+
+    [[nodiscard]] pointer get ( ) const noexcept {
+        return m_offset ? static_cast<pointer> ( frame_arena::installed ( )->address_of ( m_offset ) ) : nullptr;
+    }
+    [[nodiscard]] pointer operator-> ( ) const noexcept { return get ( ); }
+    [[nodiscard]] reference operator* ( ) const noexcept { return *get ( ); }
+    [[nodiscard]] explicit operator bool ( ) const noexcept { return m_offset; }
+
+    [[nodiscard]] offset_type raw_offset ( ) const noexcept { return m_offset; }
+
+    private:
+    offset_type m_offset = 0;
+};
+
+template<typename T>
+struct is_trivially_relocatable<frame_offset_ptr<T>> : std::true_type {};
+
+} // namespace sax
+
+#endif
@@ -0,0 +1,233 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "offset_ptr.hpp"
+
+// Deferred, batched destruction for the owning pointers, e.g. unique_ptr<T, sax::deferred_delete> or
+// sax::heap_offset_ptr<T, sax::deferred_delete>. Instead of running delete on the thread that drops the last owner,
+// the object is pushed onto a per thread queue, that is drained in batches, either at a safe point of the caller's
+// choosing (sax::deferred_delete::collect ( )), or by a sax::reclaimer, a background thread.
+
+namespace sax {
+
+class reclaimer;
+
+class deferred_delete {
+
+    friend class reclaimer;
+
+    public:
+    // Queues of this size are handed to the reclaimer, if one is running.
+    static constexpr std::size_t batch_size = 4'096;
+
+    template<typename T>
+    static void destroy ( T * p_ ) noexcept {
+        if ( p_ )
+            local ( ).push ( { p_, &destroy_object<T>, nullptr } );
+    }
+    // The slot goes back to pool_ once the object is destroyed, which may be on the reclaimer thread.
+    template<typename T, typename Pool>
+    static void destroy ( T * p_, Pool & pool_ ) noexcept {
+        local ( ).push ( { p_, &destroy_pooled<T, Pool>, &pool_ } );
+    }
+
+    // Safe point, destroys everything this thread has deferred (including the objects that are deferred while doing
+    // so), returns the number of objects destroyed.
+    static std::size_t collect ( ) noexcept { return local ( ).collect ( ); }
+
+    // Hands this thread's queue to the reclaimer, or collects it, if no reclaimer is running.
+    static void flush ( ) noexcept { local ( ).flush ( ); }
+
+    [[nodiscard]] static std::size_t pending ( ) noexcept { return local ( ).entries.size ( ); }
+
+    private:
+    struct entry {
+        void * ptr;
+        void ( *destroy ) ( void *, void * ) noexcept;
+        void * pool;
+    };
+
+    using batch = std::vector<entry>;
+
+    template<typename T>
+    static void destroy_object ( void * p_, void * ) noexcept {
+        delete static_cast<T *> ( p_ );
+    }
+    template<typename T, typename Pool>
+    static void destroy_pooled ( void * p_, void * pool_ ) noexcept {
+        std::destroy_at ( static_cast<T *> ( p_ ) );
+        static_cast<Pool *> ( pool_ )->deallocate_remote ( p_ );
+    }
+
+    static std::size_t destroy_batch ( batch & b_ ) noexcept {
+        for ( entry const & e : b_ )
+            e.destroy ( e.ptr, e.pool );
+        std::size_t const n = b_.size ( );
+        b_.clear ( );
+        return n;
+    }
+
+    struct queue {
+
+        batch entries;
+
+        ~queue ( ) noexcept { flush ( ); }
+
+        inline void push ( entry e_ ) noexcept;
+        inline void flush ( ) noexcept;
+
+        std::size_t collect ( ) noexcept {
+            std::size_t n = 0;
+            batch b;
+            // Destroying an object can defer the deletion of the objects it owns, onto this same queue.
+            while ( not entries.empty ( ) ) {
+                b.swap ( entries );
+                n += destroy_batch ( b );
+            }
+            return n;
+        }
+    };
+
+    [[nodiscard]] static queue & local ( ) noexcept {
+        static thread_local queue q;
+        return q;
+    }
+};
+
+// Destroys the batches handed to it on a background thread. At most one reclaimer can be running, it should be
+// constructed before, and destroyed after, the threads that defer to it. Its destruction destroys whatever is still
+// pending.
+
+class reclaimer {
+
+    friend class deferred_delete;
+
+    public:
+    reclaimer ( ) {
+        reclaimer * expected = nullptr;
+        if ( not running.compare_exchange_strong ( expected, this, std::memory_order_acq_rel ) )
+            throw std::runtime_error ( "reclaimer: a reclaimer is already running" );
+        m_thread = std::thread ( [ this ] { run ( ); } );
+    }
+
+    reclaimer ( reclaimer const & ) = delete;
+    reclaimer & operator= ( reclaimer const & ) = delete;
+
+    ~reclaimer ( ) noexcept {
+        {
+            std::lock_guard<std::mutex> lock ( m_mutex );
+            m_stop = true;
+        }
+        m_condition.notify_one ( );
+        m_thread.join ( );
+        running.store ( nullptr, std::memory_order_release );
+    }
+
+    // The number of objects destroyed so far.
+    [[nodiscard]] std::size_t reclaimed ( ) const noexcept { return m_reclaimed.load ( std::memory_order_relaxed ); }
+
+    private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<deferred_delete::batch> m_batches;
+    std::atomic<std::size_t> m_reclaimed = { 0 };
+    bool m_stop = false;
+    std::thread m_thread;
+
+    static inline std::atomic<reclaimer *> running = { nullptr };
+
+    [[nodiscard]] bool on_reclaimer_thread ( ) const noexcept { return std::this_thread::get_id ( ) == m_thread.get_id ( ); }
+
+    // Takes b_, unless that fails for lack of memory.
+    [[nodiscard]] bool submit ( deferred_delete::batch & b_ ) noexcept {
+        try {
+            std::lock_guard<std::mutex> lock ( m_mutex );
+            m_batches.push_back ( std::move ( b_ ) );
+        }
+        catch ( ... ) {
+            return false;
+        }
+        m_condition.notify_one ( );
+        return true;
+    }
+
+    void run ( ) noexcept {
+        std::vector<deferred_delete::batch> batches;
+        for ( bool stop = false; not stop; ) {
+            {
+                std::unique_lock<std::mutex> lock ( m_mutex );
+                m_condition.wait ( lock, [ this ] { return m_stop or not m_batches.empty ( ); } );
+                batches.swap ( m_batches );
+                stop = m_stop and batches.empty ( );
+            }
+            std::size_t n = 0;
+            for ( deferred_delete::batch & b : batches )
+                n += deferred_delete::destroy_batch ( b );
+            batches.clear ( );
+            // The objects owned by the ones just destroyed, deferred onto this thread's queue.
+            n += deferred_delete::collect ( );
+            m_reclaimed.fetch_add ( n, std::memory_order_relaxed );
+        }
+    }
+};
+
+void deferred_delete::queue::push ( entry e_ ) noexcept {
+    try {
+        entries.push_back ( e_ );
+    }
+    catch ( ... ) {
+        // Out of memory, give up on deferring this one.
+        e_.destroy ( e_.ptr, e_.pool );
+        return;
+    }
+    if ( entries.size ( ) >= batch_size and reclaimer::running.load ( std::memory_order_acquire ) )
+        flush ( );
+}
+
+void deferred_delete::queue::flush ( ) noexcept {
+    if ( entries.empty ( ) )
+        return;
+    if ( reclaimer * r = reclaimer::running.load ( std::memory_order_acquire ); r and not r->on_reclaimer_thread ( ) ) {
+        batch b;
+        b.swap ( entries );
+        if ( r->submit ( b ) )
+            return;
+        b.swap ( entries );
+    }
+    collect ( );
+}
+
+} // namespace sax
@@ -27,8 +27,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 
 #include <array>
+#include <atomic>
 #include <memory>
 #include <new>
 #include <iomanip>
@@ -37,14 +39,76 @@
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <variant>
 
 #include <experimental/fixed_capacity_vector>
 
 #include <boost/interprocess/offset_ptr.hpp>
 
+#if defined( _MSC_VER ) and not defined( __clang__ )
+#    include <xmmintrin.h>
+#endif
+
+namespace sax {
+namespace detail {
+
+// Hint the cache to start loading the line at p_, never faults, not even on nullptr.
+inline void prefetch ( void const * p_ ) noexcept {
+#if defined( _MSC_VER ) and not defined( __clang__ )
+    _mm_prefetch ( static_cast<char const *> ( p_ ), _MM_HINT_T0 );
+#else
+    __builtin_prefetch ( p_ );
+#endif
+}
+
+// Whether DeletePolicy detaches the objects it owns from something (their weak handles, see weak_handle.hpp) before
+// they are freed, or released.
+template<typename DeletePolicy, typename Type, typename = void>
+struct has_retire : std::false_type {};
+template<typename DeletePolicy, typename Type>
+struct has_retire<DeletePolicy, Type, std::void_t<decltype ( DeletePolicy::retire ( std::declval<Type *> ( ) ) )>>
+    : std::true_type {};
+
+} // namespace detail
+
+// A type is trivially relocatable if moving it to a new address, and ending the lifetime of the source, is the same
+// as a memcpy of its bytes. The pointers in this header are (the move leaves a null behind, that destructs as a
+// no-op), they are specialized below.
+
 template<typename T>
-class unique_ptr {
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template<typename T>
+inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+// Delete policies of the owning pointers, destroy is called with the pointer to be deleted (possibly nullptr), or,
+// for objects from an offset_pool, with the object and its pool, to destroy the object and return its slot. The
+// default deletes in place, sax::deferred_delete (deferred_delete.hpp) queues the object for batched destruction.
+
+struct immediate_delete {
+    template<typename T>
+    static void destroy ( T * p_ ) noexcept {
+        delete p_;
+    }
+    template<typename T, typename Pool>
+    static void destroy ( T * p_, Pool & pool_ ) noexcept {
+        std::destroy_at ( p_ );
+        pool_.deallocate ( p_ );
+    }
+};
+
+} // namespace sax
+
+// Allows clang to pass these types in registers, like a raw pointer.
+#if defined( __clang__ )
+#    define SAX_TRIVIAL_ABI [[clang::trivial_abi]]
+#else
+#    define SAX_TRIVIAL_ABI
+#endif
+
+template<typename T, typename DeletePolicy = sax::immediate_delete>
+class SAX_TRIVIAL_ABI unique_ptr {
 
     // https://lokiastari.com/blog/2014/12/30/c-plus-plus-by-example-smart-pointer/
     // https://codereview.stackexchange.com/questions/163854/my-implementation-for-stdunique-ptr
@@ -62,7 +126,7 @@ class unique_ptr {
     explicit unique_ptr ( pointer raw ) : m_data ( raw ) {}
     ~unique_ptr ( ) {
         if ( is_unique ( ) )
-            delete m_data;
+            DeletePolicy::destroy ( pointer_view ( m_data ) );
     }
 
     // Constructor/Assignment that binds to nullptr
@@ -74,21 +138,18 @@ class unique_ptr {
     }
 
     // Constructor/Assignment that allows move semantics
-    unique_ptr ( unique_ptr && moving ) noexcept { moving.swap ( *this ); }
+    unique_ptr ( unique_ptr && moving ) noexcept : m_data ( std::exchange ( moving.m_data, nullptr ) ) {}
     unique_ptr & operator= ( unique_ptr && moving ) noexcept {
         moving.swap ( *this );
         return *this;
     }
 
-    // Constructor/Assignment for use with types derived from T
+    // Constructor/Assignment for use with types derived from T, the delete policy is that of the source.
     template<typename U>
-    explicit unique_ptr ( unique_ptr<U> && moving ) noexcept {
-        unique_ptr<T> tmp ( moving.release ( ) );
-        tmp.swap ( *this );
-    }
+    explicit unique_ptr ( unique_ptr<U, DeletePolicy> && moving ) noexcept : m_data ( moving.release ( ) ) {}
     template<typename U>
-    unique_ptr & operator= ( unique_ptr<U> && moving ) noexcept {
-        unique_ptr<T> tmp ( moving.release ( ) );
+    unique_ptr & operator= ( unique_ptr<U, DeletePolicy> && moving ) noexcept {
+        unique_ptr tmp ( moving.release ( ) );
         tmp.swap ( *this );
         return *this;
     }
@@ -106,28 +167,29 @@ class unique_ptr {
     pointer get ( ) noexcept { return pointer_view ( m_data ); }
     explicit operator bool ( ) const { return pointer_view ( m_data ); }
 
-    // Modify object state
+    void prefetch ( ) const noexcept { sax::detail::prefetch ( pointer_view ( m_data ) ); }
+
+    // Modify object state, the released object is retired by the policy (if it does so), as if it were freed.
     pointer release ( ) noexcept {
         pointer result = nullptr;
         std::swap ( result, m_data );
+        if constexpr ( sax::detail::has_retire<DeletePolicy, T>::value ) {
+            if ( not( reinterpret_cast<std::uintptr_t> ( result ) & weak_mask ) )
+                DeletePolicy::retire ( pointer_view ( result ) );
+        }
         return pointer_view ( result );
     }
     void swap ( unique_ptr & src ) noexcept { std::swap ( m_data, src.m_data ); }
 
-    void reset ( ) noexcept {
-        pointer tmp = release ( );
-        delete pointer_view ( tmp );
-    }
     void reset ( pointer ptr_ = pointer ( ) ) noexcept {
         pointer result = ptr_;
         std::swap ( result, m_data );
-        delete pointer_view ( result );
+        DeletePolicy::destroy ( pointer_view ( result ) );
     }
     template<typename U>
-    void reset ( unique_ptr<U> && moving_ ) noexcept {
-        unique_ptr<T> result ( moving_ );
-        std::swap ( result, *this );
-        delete pointer_view ( result );
+    void reset ( unique_ptr<U, DeletePolicy> && moving_ ) noexcept {
+        unique_ptr result ( std::move ( moving_ ) );
+        result.swap ( *this );
     }
 
     void weakify ( ) noexcept {
@@ -162,12 +224,17 @@ class unique_ptr {
 ////////////////////////////////////////////////////////////////////////////////
 
 namespace std {
-template<typename T>
-void swap ( unique_ptr<T> & lhs, unique_ptr<T> & rhs ) {
+template<typename T, typename P>
+void swap ( unique_ptr<T, P> & lhs, unique_ptr<T, P> & rhs ) {
     lhs.swap ( rhs );
 }
 } // namespace std
 
+namespace sax {
+template<typename T, typename P>
+struct is_trivially_relocatable<unique_ptr<T, P>> : std::true_type {};
+} // namespace sax
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Stephan T Lavavej (STL!) implementation of make_unique, which has been
@@ -591,15 +658,54 @@ template<typename Type>
 thread_local typename offset_ptr<Type>::offset_base offset_ptr<Type>::base;
 */
 
-#include <Windows.h>
+#if defined( _WIN32 )
+#    include <Windows.h>
+#else
+#    include <pthread.h>
+#    include <sys/mman.h>
+#    include <unistd.h>
+#    if defined( __linux__ )
+#        include <sys/syscall.h>
+#    endif
+#endif
 
 // extern unsigned long __declspec( dllimport ) __stdcall GetProcessHeaps ( unsigned long NumberOfHeaps, void ** ProcessHeaps );
 // extern __declspec( dllimport ) void * __stdcall GetProcessHeap ( );
 
 namespace sax {
 
+// Memory placement of regions (offset_region, offset_pool). A node can be requested explicitly, or as the node of
+// the calling thread, explicit huge pages fall back to transparent huge pages, and those to normal pages. The binding
+// is skipped where the os (or machine) does not support it.
+
+enum class page_kind { normal, transparent_huge, huge };
+
+struct placement {
+    static constexpr int any_node   = -1;
+    static constexpr int local_node = -2;
+
+    int node        = any_node;
+    page_kind pages = page_kind::normal;
+};
+
+struct placement_stats {
+    placement requested;
+    int node        = placement::any_node; // The node the region is bound to, or any_node.
+    page_kind pages = page_kind::normal;   // The pages the region actually got.
+    std::size_t bytes = 0;                 // The size of the mapping.
+};
+
 namespace detail {
 
+inline constexpr std::size_t page_size      = 4'096;
+inline constexpr std::size_t huge_page_size = 2 * 1'024 * 1'024;
+
+[[nodiscard]] constexpr std::size_t round_up ( std::size_t size_, std::size_t alignment_ ) noexcept {
+    return ( size_ + alignment_ - 1 ) & ~( alignment_ - 1 );
+}
+
+#if defined( _WIN32 )
+
 namespace win {
 
 inline std::vector<void *> heaps ( ) noexcept {
@@ -612,17 +718,313 @@ inline std::vector<void *> heaps ( ) noexcept {
 
 inline void * heap ( ) noexcept { return GetProcessHeap ( ); }
 
+// The top (highest address) of the stack of the calling thread.
 inline void * stack ( ) noexcept {
-    volatile void * p = std::addressof ( p );
-    return const_cast<void *> ( p );
+    ULONG_PTR low = 0, high = 0;
+    GetCurrentThreadStackLimits ( &low, &high );
+    return reinterpret_cast<void *> ( high );
+}
+
+// Pages, for regions.
+
+inline void * map ( std::size_t size_ ) noexcept {
+    return VirtualAlloc ( nullptr, size_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+}
+inline void unmap ( void * p_, std::size_t ) noexcept { VirtualFree ( p_, 0, MEM_RELEASE ); }
+// The contents of the pages are no longer of interest, they can be reused without being paged out.
+inline void discard ( void * p_, std::size_t size_ ) noexcept { VirtualAlloc ( p_, size_, MEM_RESET, PAGE_READWRITE ); }
+
+[[nodiscard]] inline int current_node ( ) noexcept {
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx ( &processor );
+    USHORT node = 0;
+    return GetNumaProcessorNodeEx ( &processor, &node ) ? static_cast<int> ( node ) : placement::any_node;
+}
+
+// Large pages require the SeLockMemoryPrivilege, without it, or without a numa node, this is plain map.
+inline void * map ( std::size_t size_, placement const & where_, placement_stats & stats_ ) noexcept {
+    stats_           = { where_, placement::any_node, page_kind::normal, size_ };
+    int const node   = placement::local_node == where_.node ? current_node ( ) : where_.node;
+    auto allocate    = [ node ] ( std::size_t size, DWORD type ) noexcept -> void * {
+        if ( node >= 0 )
+            return VirtualAllocExNuma ( GetCurrentProcess ( ), nullptr, size, type, PAGE_READWRITE, static_cast<DWORD> ( node ) );
+        return VirtualAlloc ( nullptr, size, type, PAGE_READWRITE );
+    };
+    void * p = nullptr;
+    if ( page_kind::huge == where_.pages ) {
+        if ( std::size_t const large = GetLargePageMinimum ( ); large ) {
+            std::size_t const size = round_up ( size_, large );
+            if ( ( p = allocate ( size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES ) ) )
+                stats_ = { where_, placement::any_node, page_kind::huge, size };
+        }
+    }
+    if ( not p )
+        p = allocate ( size_, MEM_RESERVE | MEM_COMMIT );
+    if ( p and node >= 0 )
+        stats_.node = node;
+    return p;
 }
 } // namespace win
 
+namespace os = win;
+
+#else
+
+namespace posix {
+
+// No base, the allocations of malloc are not in reach of a 16-bit offset from any fixed address, heap offsets are
+// relative to an installed offset_pool or offset_region.
+inline void * heap ( ) noexcept { return nullptr; }
+
+// The top (highest address) of the stack of the calling thread, or, if the bounds are not available, the current
+// frame.
+inline void * stack ( ) noexcept {
+#    if defined( __linux__ )
+    pthread_attr_t attr;
+    if ( not pthread_getattr_np ( pthread_self ( ), &attr ) ) {
+        void * low       = nullptr;
+        std::size_t size = 0;
+        int const error  = pthread_attr_getstack ( &attr, &low, &size );
+        pthread_attr_destroy ( &attr );
+        if ( not error and low )
+            return static_cast<char *> ( low ) + size;
+    }
+#    elif defined( __APPLE__ )
+    if ( void * high = pthread_get_stackaddr_np ( pthread_self ( ) ) )
+        return high;
+#    endif
+    return __builtin_frame_address ( 0 );
+}
+
+// Pages, for regions.
+
+inline void * map ( std::size_t size_ ) noexcept {
+    void * p = mmap ( nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    return MAP_FAILED == p ? nullptr : p;
+}
+inline void unmap ( void * p_, std::size_t size_ ) noexcept { munmap ( p_, size_ ); }
+// Return the pages to the os, they read back as zero.
+inline void discard ( void * p_, std::size_t size_ ) noexcept { madvise ( p_, size_, MADV_DONTNEED ); }
+
+#    if defined( __linux__ )
+
+// The numa system calls, directly, so there is no dependency on libnuma.
+
+[[nodiscard]] inline int current_node ( ) noexcept {
+    unsigned cpu = 0, node = 0;
+    return syscall ( SYS_getcpu, &cpu, &node, nullptr ) ? placement::any_node : static_cast<int> ( node );
+}
+
+[[nodiscard]] inline bool bind ( void * p_, std::size_t size_, int node_ ) noexcept {
+    constexpr int mpol_bind                = 2;
+    constexpr unsigned long max_nodes      = sizeof ( unsigned long ) * 8;
+    if ( node_ < 0 or static_cast<unsigned long> ( node_ ) >= max_nodes )
+        return false;
+    unsigned long const mask = 1ul << node_;
+    return not syscall ( SYS_mbind, p_, size_, mpol_bind, &mask, max_nodes + 1, 0u );
+}
+
+// Map size_ bytes, aligned to a huge page, by over-mapping and trimming.
+[[nodiscard]] inline void * map_huge_aligned ( std::size_t size_ ) noexcept {
+    char * p = static_cast<char *> ( map ( size_ + huge_page_size ) );
+    if ( not p )
+        return nullptr;
+    char * const aligned = reinterpret_cast<char *> ( round_up ( reinterpret_cast<std::uintptr_t> ( p ), huge_page_size ) );
+    if ( aligned != p )
+        munmap ( p, static_cast<std::size_t> ( aligned - p ) );
+    if ( std::size_t const tail = static_cast<std::size_t> ( p + size_ + huge_page_size - ( aligned + size_ ) ); tail )
+        munmap ( aligned + size_, tail );
+    return aligned;
+}
+
+inline void * map ( std::size_t size_, placement const & where_, placement_stats & stats_ ) noexcept {
+    stats_ = { where_, placement::any_node, page_kind::normal, size_ };
+    void * p = nullptr;
+    if ( page_kind::normal != where_.pages ) {
+        std::size_t const size = round_up ( size_, huge_page_size );
+        if ( page_kind::huge == where_.pages ) {
+            p = mmap ( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+            if ( MAP_FAILED == p )
+                p = nullptr;
+            else
+                stats_ = { where_, placement::any_node, page_kind::huge, size };
+        }
+        if ( not p and ( p = map_huge_aligned ( size ) ) ) {
+            stats_ = { where_, placement::any_node,
+                       madvise ( p, size, MADV_HUGEPAGE ) ? page_kind::normal : page_kind::transparent_huge, size };
+        }
+    }
+    if ( not p )
+        p = map ( size_ );
+    if ( p and placement::any_node != where_.node ) {
+        // Before the first touch, so that all pages are allocated on the node.
+        int const node = placement::local_node == where_.node ? current_node ( ) : where_.node;
+        if ( bind ( p, stats_.bytes, node ) )
+            stats_.node = node;
+    }
+    return p;
+}
+
+#    else
+
+inline void * map ( std::size_t size_, placement const & where_, placement_stats & stats_ ) noexcept {
+    stats_ = { where_, placement::any_node, page_kind::normal, size_ };
+    return map ( size_ );
+}
+
+#    endif
+} // namespace posix
+
+namespace os = posix;
+
+#endif
+
+// The pages of a region, unmapped on destruction.
+class mapping {
+
+    public:
+    explicit mapping ( std::size_t size_, placement const & where_ = { } ) : m_data ( os::map ( size_, where_, m_stats ) ) {
+        if ( not m_data )
+            throw std::bad_alloc ( );
+    }
+
+    mapping ( mapping const & ) = delete;
+    mapping & operator= ( mapping const & ) = delete;
+
+    ~mapping ( ) noexcept { os::unmap ( m_data, m_stats.bytes ); }
+
+    [[nodiscard]] void * data ( ) const noexcept { return m_data; }
+    [[nodiscard]] placement_stats const & stats ( ) const noexcept { return m_stats; }
+
+    private:
+    placement_stats m_stats;
+    void * m_data;
+};
+
 struct heap_offset_ptr_pointer {};
 struct stack_offset_ptr_pointer {};
 
+template<typename DeletePolicy, typename Type, typename Pool, typename = void>
+struct has_pool_destroy : std::false_type {};
+template<typename DeletePolicy, typename Type, typename Pool>
+struct has_pool_destroy<DeletePolicy, Type, Pool,
+                        std::void_t<decltype ( DeletePolicy::destroy ( std::declval<Type *> ( ), std::declval<Pool &> ( ) ) )>>
+    : std::true_type {};
+
+// The per thread base of all offset_ptr<Type, Where, ...>, whatever their delete policy. Heap offsets count up from
+// their base, stack offsets count down from the top of the stack of the thread (the stack grows down), so that the
+// frames closest to the top are the ones in range, offset 0, the top itself, is null.
 template<typename Type, typename Where>
-struct offset_ptr {
+struct offset_ptr_base {
+
+    [[nodiscard]] static Type * base_pointer ( ) noexcept {
+        if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
+            return static_cast<Type *> ( os::heap ( ) );
+        }
+        else {
+            return static_cast<Type *> ( os::stack ( ) );
+        }
+    }
+
+    static thread_local Type * ptr;
+};
+
+template<typename Type, typename Where>
+thread_local Type * offset_ptr_base<Type, Where>::ptr = offset_ptr_base::base_pointer ( );
+
+// A slab of fixed size slots for the objects of a heap_offset_ptr<Type>. The free list is threaded through the free
+// slots themselves, as 16-bit offsets, slots that were never used are handed out from the top. While a pool is
+// installed (on the thread that constructed it), it is the base of heap_offset_ptr<Type>, make_heap_offset
+// allocates from it and the owning pointers return their pointees to it, through their delete policy. Slots freed
+// on other threads (by a sax::reclaimer) go onto a second, lock-free, list, that the owning thread takes over when
+// its own list runs dry. All objects must be destroyed (deferred ones collected) before the pool is.
+
+template<typename Type>
+class offset_pool {
+
+    public:
+    using value_type    = Type;
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using size_type   = std::size_t;
+    using offset_type = std::uint16_t;
+
+    // The weak bit is not available for addressing, slot 0 is null.
+    static constexpr size_type slots = size_type{ 1 } << ( sizeof ( offset_type ) * 8 - 1 );
+    static constexpr size_type bytes = round_up ( slots * sizeof ( value_type ), page_size );
+
+    static_assert ( sizeof ( value_type ) >= sizeof ( offset_type ), "a slot must be able to hold a free list link" );
+    static_assert ( alignof ( value_type ) <= page_size, "over-aligned types are not supported" );
+
+    explicit offset_pool ( placement const & where_ = { } ) :
+        m_map ( bytes, where_ ), m_data ( static_cast<pointer> ( m_map.data ( ) ) ) {
+        m_previous      = std::exchange ( base_type::ptr, m_data );
+        m_previous_pool = std::exchange ( current, this );
+    }
+
+    offset_pool ( offset_pool const & ) = delete;
+    offset_pool & operator= ( offset_pool const & ) = delete;
+
+    ~offset_pool ( ) noexcept {
+        current        = m_previous_pool;
+        base_type::ptr = m_previous;
+    }
+
+    // Returns an uninitialized slot, or nullptr if the pool is exhausted.
+    [[nodiscard]] void * allocate ( ) noexcept {
+        if ( not m_free and m_remote.load ( std::memory_order_relaxed ) )
+            m_free = m_remote.exchange ( 0, std::memory_order_acquire );
+        if ( m_free ) {
+            void * p = m_data + m_free;
+            std::memcpy ( &m_free, p, sizeof ( offset_type ) );
+            return p;
+        }
+        return m_top < slots ? m_data + m_top++ : nullptr;
+    }
+
+    void deallocate ( void * p_ ) noexcept {
+        std::memcpy ( p_, &m_free, sizeof ( offset_type ) );
+        m_free = static_cast<offset_type> ( static_cast<pointer> ( p_ ) - m_data );
+    }
+
+    // Deallocate from any thread. The list is only ever taken as a whole (in allocate), so the push is free of ABA.
+    void deallocate_remote ( void * p_ ) noexcept {
+        offset_type const o = static_cast<offset_type> ( static_cast<pointer> ( p_ ) - m_data );
+        offset_type head    = m_remote.load ( std::memory_order_relaxed );
+        do
+            std::memcpy ( p_, &head, sizeof ( offset_type ) );
+        while ( not m_remote.compare_exchange_weak ( head, o, std::memory_order_release, std::memory_order_relaxed ) );
+    }
+
+    [[nodiscard]] bool contains ( const_pointer p_ ) const noexcept { return m_data < p_ and p_ < m_data + m_top; }
+
+    [[nodiscard]] pointer data ( ) const noexcept { return m_data; }
+
+    [[nodiscard]] placement_stats const & stats ( ) const noexcept { return m_map.stats ( ); }
+
+    // The pool installed on this thread, if any.
+    [[nodiscard]] static offset_pool * installed ( ) noexcept { return current; }
+
+    private:
+    using base_type = offset_ptr_base<Type, heap_offset_ptr_pointer>;
+
+    mapping m_map;
+    pointer m_data;
+    pointer m_previous;
+    offset_pool * m_previous_pool;
+    offset_type m_free = 0;
+    size_type m_top    = 1;
+    std::atomic<offset_type> m_remote = { 0 };
+
+    static thread_local offset_pool * current;
+};
+
+template<typename Type>
+thread_local offset_pool<Type> * offset_pool<Type>::current = nullptr;
+
+template<typename Type, typename Where, typename DeletePolicy = immediate_delete>
+struct SAX_TRIVIAL_ABI offset_ptr {
     public:
     using value_type    = Type;
     using pointer       = value_type *;
@@ -643,22 +1045,24 @@ struct offset_ptr {
 
     explicit offset_ptr ( offset_ptr const & ) noexcept = delete;
 
-    offset_ptr ( offset_ptr && moving ) noexcept { moving.swap ( *this ); }
+    offset_ptr ( offset_ptr && moving ) noexcept : offset ( std::exchange ( moving.offset, offset_type{ 0 } ) ) {}
 
+    // The delete policy is that of the source.
     template<typename U, typename W>
-    explicit offset_ptr ( offset_ptr<U, W> && moving ) noexcept {
-        offset_ptr<value_type, Where> tmp ( moving.release ( ) );
+    explicit offset_ptr ( offset_ptr<U, W, DeletePolicy> && moving ) noexcept {
+        offset_ptr tmp ( moving.release ( ) );
         tmp.swap ( *this );
     }
 
-    offset_ptr ( pointer p_ ) noexcept : offset ( offset_from_ptr ( p_ ) ) { assert ( get ( ) == p_ ); }
+    // Throws if p_ is not in range of the base.
+    offset_ptr ( pointer p_ ) : offset ( checked_offset ( p_ ) ) {}
 
     // Destruct.
 
     ~offset_ptr ( ) noexcept {
         if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
-            if ( is_unique ( ) )
-                delete get ( );
+            if ( owns ( offset ) )
+                dispose ( get ( ) );
         }
     }
 
@@ -677,15 +1081,14 @@ struct offset_ptr {
     }
 
     template<typename U, typename W>
-    [[maybe_unused]] offset_ptr & operator= ( offset_ptr<U, W> && moving ) noexcept {
-        offset_ptr<Type, Where> tmp ( moving.release ( ) );
+    [[maybe_unused]] offset_ptr & operator= ( offset_ptr<U, W, DeletePolicy> && moving ) noexcept {
+        offset_ptr tmp ( moving.release ( ) );
         tmp.swap ( *this );
         return *this;
     }
 
-    [[maybe_unused]] offset_ptr & operator= ( pointer p_ ) noexcept {
-        offset = offset_from_pointer ( p_ );
-        assert ( get ( ) == p_ );
+    [[maybe_unused]] offset_ptr & operator= ( pointer p_ ) {
+        offset = checked_offset ( p_ );
         return *this;
     }
 
@@ -699,45 +1102,57 @@ struct offset_ptr {
 
     [[nodiscard]] pointer get ( ) const noexcept { return offset_ptr::ptr_from_offset ( offset_view ( offset ) ); }
     [[nodiscard]] pointer get ( ) noexcept { return std::as_const ( *this ).get ( ); }
+    [[nodiscard]] explicit operator bool ( ) const noexcept { return offset_view ( offset ); }
 
     [[nodiscard]] static pointer get ( offset_type offset_ ) noexcept { return ptr_from_offset ( offset_view ( offset_ ) ); }
 
+    void prefetch ( ) const noexcept { detail::prefetch ( get ( ) ); }
+
+    [[nodiscard]] offset_type raw_offset ( ) const noexcept { return offset; }
+    // Rebind to o_ (including the weak bit), used by relocation, that moves the pointee.
+    void set_raw_offset ( offset_type o_ ) noexcept { offset = o_; }
+    [[nodiscard]] static pointer base_ptr ( ) noexcept { return base_type::ptr; }
+
     [[nodiscard]] static size_type max_size ( ) noexcept {
         return static_cast<size_type> ( std::numeric_limits<offset_type>::max ( ) ) >> 1;
     }
 
-    void swap ( offset_ptr & src ) noexcept { std::swap ( *this, src ); }
+    // Whether p_ is nullptr, or at a non-zero offset that fits, from the current base.
+    [[nodiscard]] static bool in_range ( const_pointer p_ ) noexcept {
+        if ( not p_ )
+            return true;
+        std::uintptr_t const b = reinterpret_cast<std::uintptr_t> ( base_type::ptr ), p = reinterpret_cast<std::uintptr_t> ( p_ );
+        std::uintptr_t const d = std::is_same<Where, heap_offset_ptr_pointer>::value ? p - b : b - p;
+        return d and d <= offset_view ( offset_type ( ~0 ) ) * sizeof ( value_type ) and not( d % sizeof ( value_type ) );
+    }
+
+    void swap ( offset_ptr & src ) noexcept { std::swap ( offset, src.offset ); }
 
     // Other.
 
+    // The released object is retired by the policy (if it does so), as if it were freed.
     [[nodiscard]] pointer release ( ) noexcept {
         offset_type result = { };
         std::swap ( result, offset );
+        if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value and has_retire<DeletePolicy, Type>::value ) {
+            if ( owns ( result ) )
+                DeletePolicy::retire ( get ( result ) );
+        }
         return get ( result );
     }
 
-    void reset ( ) noexcept {
-        if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
-            if ( is_unique ( ) )
-                delete release ( );
-        }
-    }
-    void reset ( pointer p_ = pointer ( ) ) noexcept {
-        offset_type result = offset_from_ptr ( p_ );
+    void reset ( pointer p_ = pointer ( ) ) {
+        offset_type result = checked_offset ( p_ );
         std::swap ( result, offset );
         if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
-            if ( is_unique ( ) )
-                delete get ( result );
+            if ( owns ( result ) )
+                dispose ( get ( result ) );
         }
     }
     template<typename U, typename W>
-    void reset ( offset_ptr<U, W> && moving_ ) noexcept {
-        offset_ptr<Type, Where> result ( moving_ );
-        std::swap ( result, *this );
-        if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
-            if ( is_unique ( ) )
-                delete result.get ( );
-        }
+    void reset ( offset_ptr<U, W, DeletePolicy> && moving_ ) noexcept {
+        offset_ptr result ( std::move ( moving_ ) );
+        result.swap ( *this );
     }
 
     template<typename W = Where>
@@ -757,14 +1172,7 @@ struct offset_ptr {
         return not is_weak ( );
     }
 
-    private:
-    offset_type offset = { };
-
-    [[nodiscard]] pointer addressof_this ( ) const noexcept {
-        return reinterpret_cast<pointer> ( const_cast<offset_ptr *> ( this ) );
-    }
-
-    // Static class functions and variables.
+    // Offset encoding, shared with the bulk operations in offset_ptr_array.
 
     [[nodiscard]] static constexpr offset_type offset_view ( offset_type o_ ) noexcept {
         if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
@@ -775,22 +1183,77 @@ struct offset_ptr {
         }
     }
 
+    // Offset 0 is null, both ways, nullptr encodes as 0 and 0 (weak or not) decodes as nullptr.
     [[nodiscard]] static offset_type offset_from_ptr ( pointer p_ ) noexcept {
-        return static_cast<offset_type> ( p_ - offset_ptr::base );
+        if ( not p_ )
+            return 0;
+        if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
+            return static_cast<offset_type> ( p_ - base_type::ptr );
+        }
+        else {
+            return static_cast<offset_type> ( base_type::ptr - p_ );
+        }
+    }
+    [[nodiscard]] static offset_type checked_offset ( pointer p_ ) {
+        if ( not in_range ( p_ ) )
+            throw std::runtime_error ( "offset_ptr: pointer out of range of the base" );
+        return offset_from_ptr ( p_ );
     }
     [[nodiscard]] static pointer ptr_from_offset ( offset_type const offset_ ) noexcept {
+        offset_type const o = offset_ptr::offset_view ( offset_ );
+        if ( not o )
+            return nullptr;
+        // In integers, the base is not an object that the pointee is part of (the compiler would think so, and warn
+        // on the delete of the pointee).
+        std::uintptr_t const b = reinterpret_cast<std::uintptr_t> ( base_type::ptr ), d = o * sizeof ( value_type );
         if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
-            return offset_ptr::base + offset_ptr::offset_view ( offset_ );
+            return reinterpret_cast<pointer> ( b + d );
+        }
+        else {
+            return reinterpret_cast<pointer> ( b - d );
+        }
+    }
+
+    private:
+    using base_type = offset_ptr_base<Type, Where>;
+
+    offset_type offset = { };
+
+    // Offset 0 is null, a weak offset does not own its pointee.
+    [[nodiscard]] static constexpr bool owns ( offset_type o_ ) noexcept {
+        return offset_view ( o_ ) and not( o_ & weak_mask );
+    }
+
+    // Objects from the installed pool go to the delete policy with their pool (so that a deferring policy returns the
+    // slot when it gets round to the object), others to the delete policy. A policy without a pool overload is bypassed
+    // for pooled objects, they are destroyed in place.
+    static void dispose ( pointer p_ ) noexcept {
+        if ( offset_pool<Type> * pool = offset_pool<Type>::installed ( ); pool and pool->contains ( p_ ) ) {
+            if constexpr ( has_pool_destroy<DeletePolicy, Type, offset_pool<Type>>::value ) {
+                DeletePolicy::destroy ( p_, *pool );
+            }
+            else {
+                std::destroy_at ( p_ );
+                pool->deallocate ( p_ );
+            }
         }
         else {
-            return offset_ptr::base + offset_;
+            DeletePolicy::destroy ( p_ );
         }
     }
 
+    [[nodiscard]] pointer addressof_this ( ) const noexcept {
+        return reinterpret_cast<pointer> ( const_cast<offset_ptr *> ( this ) );
+    }
+
+    // Static class functions and variables.
+
     [[nodiscard]] static constexpr offset_type make_weak_mask ( ) noexcept {
-        return static_cast<offset_type> ( std::uint64_t ( 1 ) << ( sizeof ( size_type ) * 8 - 1 ) );
+        return static_cast<offset_type> ( std::uint64_t ( 1 ) << ( sizeof ( offset_type ) * 8 - 1 ) );
+    }
+    [[nodiscard]] static constexpr offset_type make_offset_mask ( ) noexcept {
+        return static_cast<offset_type> ( ~make_weak_mask ( ) );
     }
-    [[nodiscard]] static constexpr offset_type make_offset_mask ( ) noexcept { return ~make_weak_mask ( ); }
 
     static constexpr offset_type weak_mask   = offset_ptr::make_weak_mask ( );
     static constexpr offset_type offset_mask = offset_ptr::make_offset_mask ( );
@@ -802,26 +1265,37 @@ struct offset_ptr {
     [[nodiscard]] static int pointer_alignment ( void * ptr_ ) noexcept {
         return ( int ) ( ( ( std::uintptr_t ) ptr_ ) & ( ( std::uintptr_t ) ( -( ( std::intptr_t ) ptr_ ) ) ) );
     }
-
-    [[nodiscard]] static pointer base_pointer ( ) noexcept {
-        if constexpr ( std::is_same<Where, heap_offset_ptr_pointer>::value ) {
-            return static_cast<pointer> ( win::heap ( ) );
-        }
-        else {
-            return static_cast<pointer> ( win::stack ( ) );
-        }
-    }
-
-    static thread_local pointer base;
 };
 
-template<typename Type, typename Where>
-thread_local typename offset_ptr<Type, Where>::pointer offset_ptr<Type, Where>::base = offset_ptr::base_pointer ( );
-
 } // namespace detail
 
+template<typename Type, typename Where, typename DeletePolicy>
+struct is_trivially_relocatable<detail::offset_ptr<Type, Where, DeletePolicy>> : std::true_type {};
+
+template<typename Type, typename DeletePolicy = immediate_delete>
+using heap_offset_ptr = detail::offset_ptr<Type, detail::heap_offset_ptr_pointer, DeletePolicy>;
+
 template<typename Type>
-using heap_offset_ptr = detail::offset_ptr<Type, detail::heap_offset_ptr_pointer>;
+using offset_pool = detail::offset_pool<Type>;
+
+// Construct a Type in the installed offset_pool<Type>, throws if there is none (a heap allocation would not, in
+// general, be addressable by a 16-bit offset).
+template<typename Type, typename DeletePolicy = immediate_delete, typename... Args>
+[[nodiscard]] heap_offset_ptr<Type, DeletePolicy> make_heap_offset ( Args &&... args_ ) {
+    offset_pool<Type> * pool = offset_pool<Type>::installed ( );
+    if ( not pool )
+        throw std::runtime_error ( "make_heap_offset: no offset_pool installed" );
+    void * p = pool->allocate ( );
+    if ( not p )
+        throw std::bad_alloc ( );
+    try {
+        return heap_offset_ptr<Type, DeletePolicy> ( ::new ( p ) Type ( std::forward<Args> ( args_ )... ) );
+    }
+    catch ( ... ) {
+        pool->deallocate ( p );
+        throw;
+    }
+}
 
 template<typename Type>
 using stack_offset_ptr = detail::offset_ptr<Type, detail::stack_offset_ptr_pointer>;
@@ -0,0 +1,224 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#if defined( __AVX2__ )
+#    include <immintrin.h>
+#endif
+
+#include "offset_ptr.hpp"
+
+namespace sax {
+
+// A contiguous array of offsets (adjacency lists, bucket arrays), decoded, gathered through and encoded in bulk. The
+// array does not own the pointees, it is a compact view of links into the region of offset_ptr<Type, Where>.
+
+template<typename Type, typename Where>
+class offset_ptr_array {
+
+    public:
+    using offset_ptr_type = detail::offset_ptr<Type, Where>;
+
+    using value_type    = Type;
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using offset_type = typename offset_ptr_type::offset_type;
+    using size_type   = std::size_t;
+
+    // Stack offsets count down from their base.
+    static constexpr bool downward = std::is_same<Where, detail::stack_offset_ptr_pointer>::value;
+
+    using container_type = std::vector<offset_type>;
+
+    offset_ptr_array ( ) noexcept = default;
+    explicit offset_ptr_array ( size_type n_ ) : m_data ( n_ ) {}
+    offset_ptr_array ( pointer const * first_, size_type n_ ) { assign ( first_, n_ ); }
+
+    // Size.
+
+    [[nodiscard]] size_type size ( ) const noexcept { return m_data.size ( ); }
+    [[nodiscard]] bool empty ( ) const noexcept { return m_data.empty ( ); }
+
+    void reserve ( size_type n_ ) { m_data.reserve ( n_ ); }
+    void resize ( size_type n_ ) { m_data.resize ( n_ ); }
+    void clear ( ) noexcept { m_data.clear ( ); }
+
+    // Element access.
+
+    [[nodiscard]] pointer operator[] ( size_type i_ ) const noexcept { return offset_ptr_type::get ( m_data[ i_ ] ); }
+
+    [[nodiscard]] offset_type offset ( size_type i_ ) const noexcept { return m_data[ i_ ]; }
+
+    [[nodiscard]] offset_type const * data ( ) const noexcept { return m_data.data ( ); }
+    [[nodiscard]] offset_type * data ( ) noexcept { return m_data.data ( ); }
+
+    // Modifiers.
+
+    void push_back ( pointer p_ ) {
+        if ( not in_range ( p_ ) )
+            throw std::runtime_error ( "offset_ptr_array: pointer out of range" );
+        m_data.push_back ( offset_ptr_type::offset_from_ptr ( p_ ) );
+    }
+
+    void assign ( pointer const * first_, size_type n_ ) {
+        container_type data ( n_ );
+        if ( not encode ( first_, n_, data.data ( ) ) )
+            throw std::runtime_error ( "offset_ptr_array: pointer out of range" );
+        m_data = std::move ( data );
+    }
+
+    // Bulk operations.
+
+    void decode ( pointer * dst_ ) const noexcept { decode ( m_data.data ( ), m_data.size ( ), dst_ ); }
+
+    template<typename Field>
+    void gather ( Field Type::*field_, Field * dst_ ) const noexcept {
+        gather ( m_data.data ( ), m_data.size ( ), field_, dst_ );
+    }
+
+    // Decode n_ offsets into raw pointers, null offsets into nullptr.
+    static void decode ( offset_type const * src_, size_type n_, pointer * dst_ ) noexcept {
+        size_type i = 0;
+#if defined( __AVX2__ ) and ( UINTPTR_MAX == 0xFFFF'FFFF'FFFF'FFFF )
+        if constexpr ( not downward ) {
+            __m128i const mask = _mm_set1_epi16 ( static_cast<short> ( offset_ptr_type::offset_view ( offset_type ( ~0 ) ) ) );
+            __m256i const size = _mm256_set1_epi64x ( static_cast<long long> ( sizeof ( Type ) ) );
+            __m256i const base = _mm256_set1_epi64x ( static_cast<long long> ( reinterpret_cast<std::uintptr_t> ( base_ptr ( ) ) ) );
+            // One 256-bit load of 16 offsets, widened into four vectors of 4 pointers each.
+            for ( ; i + 16 <= n_; i += 16 ) {
+                __m256i const o = _mm256_loadu_si256 ( reinterpret_cast<__m256i const *> ( src_ + i ) );
+                __m128i const lo = _mm_and_si128 ( _mm256_castsi256_si128 ( o ), mask );
+                __m128i const hi = _mm_and_si128 ( _mm256_extracti128_si256 ( o, 1 ), mask );
+                store_pointers ( dst_ + i + 0, lo, size, base );
+                store_pointers ( dst_ + i + 4, _mm_unpackhi_epi64 ( lo, lo ), size, base );
+                store_pointers ( dst_ + i + 8, hi, size, base );
+                store_pointers ( dst_ + i + 12, _mm_unpackhi_epi64 ( hi, hi ), size, base );
+            }
+        }
+#endif
+        for ( ; i < n_; ++i )
+            dst_[ i ] = offset_ptr_type::get ( src_[ i ] );
+    }
+
+    // Load the field field_ of each of the n_ pointees, without materialising the pointers, none of the offsets may be
+    // null.
+    template<typename Field>
+    static void gather ( offset_type const * src_, size_type n_, Field Type::*field_, Field * dst_ ) noexcept {
+        static_assert ( std::is_trivially_copyable<Field>::value, "gathered fields must be trivially copyable" );
+        size_type i = 0;
+#if defined( __AVX2__ )
+        if constexpr ( not downward and ( sizeof ( Field ) == 4 or sizeof ( Field ) == 8 ) and
+                       sizeof ( Type ) * offset_ptr_type::offset_view ( offset_type ( ~0 ) ) + sizeof ( Type ) <=
+                           static_cast<std::size_t> ( std::numeric_limits<int>::max ( ) ) ) {
+            char const * const base = reinterpret_cast<char const *> ( base_ptr ( ) );
+            int const field_offset  = static_cast<int> ( field_offset_of ( field_ ) );
+            __m128i const mask      = _mm_set1_epi16 ( static_cast<short> ( offset_ptr_type::offset_view ( offset_type ( ~0 ) ) ) );
+            if constexpr ( sizeof ( Field ) == 4 ) {
+                __m256i const size   = _mm256_set1_epi32 ( static_cast<int> ( sizeof ( Type ) ) );
+                __m256i const member = _mm256_set1_epi32 ( field_offset );
+                // 8 fields per gather instruction.
+                for ( ; i + 8 <= n_; i += 8 ) {
+                    __m128i const o = _mm_and_si128 ( _mm_loadu_si128 ( reinterpret_cast<__m128i const *> ( src_ + i ) ), mask );
+                    __m256i const b = _mm256_add_epi32 ( _mm256_mullo_epi32 ( _mm256_cvtepu16_epi32 ( o ), size ), member );
+                    _mm256_storeu_si256 ( reinterpret_cast<__m256i *> ( dst_ + i ),
+                                          _mm256_i32gather_epi32 ( reinterpret_cast<int const *> ( base ), b, 1 ) );
+                }
+            }
+            else {
+                __m128i const size   = _mm_set1_epi32 ( static_cast<int> ( sizeof ( Type ) ) );
+                __m128i const member = _mm_set1_epi32 ( field_offset );
+                // 4 fields per gather instruction.
+                for ( ; i + 4 <= n_; i += 4 ) {
+                    __m128i const o = _mm_and_si128 ( _mm_loadl_epi64 ( reinterpret_cast<__m128i const *> ( src_ + i ) ), mask );
+                    __m128i const b = _mm_add_epi32 ( _mm_mullo_epi32 ( _mm_cvtepu16_epi32 ( o ), size ), member );
+                    _mm256_storeu_si256 ( reinterpret_cast<__m256i *> ( dst_ + i ),
+                                          _mm256_i32gather_epi64 ( reinterpret_cast<long long const *> ( base ), b, 1 ) );
+                }
+            }
+        }
+#endif
+        for ( ; i < n_; ++i )
+            std::memcpy ( dst_ + i, std::addressof ( offset_ptr_type::get ( src_[ i ] )->*field_ ), sizeof ( Field ) );
+    }
+
+    // Encode n_ pointers into offsets (nullptr into 0), returns false (and leaves dst_ unspecified) if any of the
+    // pointers is not addressable from the current base. The loop is branch-free, so that the compiler can vectorise
+    // it, the range check is folded into a single test at the end.
+    [[nodiscard]] static bool encode ( pointer const * src_, size_type n_, offset_type * dst_ ) noexcept {
+        std::uintptr_t const base = reinterpret_cast<std::uintptr_t> ( base_ptr ( ) );
+        std::uintptr_t const last = offset_ptr_type::offset_view ( offset_type ( ~0 ) ) * sizeof ( Type );
+        std::uintptr_t invalid    = 0;
+        for ( size_type i = 0; i < n_; ++i ) {
+            std::uintptr_t const live = nullptr != src_[ i ];
+            std::uintptr_t const d    = distance ( base, src_[ i ] ) & -live;
+            // A pointer at the base itself would encode as null.
+            invalid |= static_cast<std::uintptr_t> ( d > last ) | ( d % sizeof ( Type ) ) | ( live & not d );
+            dst_[ i ] = static_cast<offset_type> ( d / sizeof ( Type ) );
+        }
+        return not invalid;
+    }
+
+    [[nodiscard]] static bool in_range ( pointer p_ ) noexcept { return offset_ptr_type::in_range ( p_ ); }
+
+    private:
+    container_type m_data;
+
+    [[nodiscard]] static pointer base_ptr ( ) noexcept { return offset_ptr_type::base_ptr ( ); }
+
+    // The distance in bytes from the base to p_, in the direction of the offsets.
+    [[nodiscard]] static std::uintptr_t distance ( std::uintptr_t base_, pointer p_ ) noexcept {
+        std::uintptr_t const p = reinterpret_cast<std::uintptr_t> ( p_ );
+        return downward ? base_ - p : p - base_;
+    }
+
+    template<typename Field>
+    [[nodiscard]] static std::size_t field_offset_of ( Field Type::*field_ ) noexcept {
+        pointer const p = base_ptr ( );
+        return static_cast<std::size_t> ( reinterpret_cast<char const *> ( std::addressof ( p->*field_ ) ) -
+                                          reinterpret_cast<char const *> ( p ) );
+    }
+
+#if defined( __AVX2__ ) and ( UINTPTR_MAX == 0xFFFF'FFFF'FFFF'FFFF )
+    // Widen the low 4 offsets of o_ and store base_ + o_ * size_ (or nullptr, for offset 0) as 4 pointers.
+    static void store_pointers ( pointer * dst_, __m128i o_, __m256i size_, __m256i base_ ) noexcept {
+        __m256i const o    = _mm256_cvtepu16_epi64 ( o_ );
+        __m256i const null = _mm256_cmpeq_epi64 ( o, _mm256_setzero_si256 ( ) );
+        _mm256_storeu_si256 ( reinterpret_cast<__m256i *> ( dst_ ),
+                              _mm256_andnot_si256 ( null, _mm256_add_epi64 ( base_, _mm256_mul_epu32 ( o, size_ ) ) ) );
+    }
+#endif
+};
+
+} // namespace sax
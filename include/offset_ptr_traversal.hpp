@@ -0,0 +1,133 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <utility>
+
+#include "offset_ptr.hpp"
+
+// Traversal of pointer-linked structures, that hides memory latency by prefetching ahead and by interleaving
+// independent chains (group prefetching, in the rolling form of AMAC, Kocberber et al. 2015). Nodes are passed
+// around as raw pointers, the step functions do the dereferencing, e.g. [] ( node * n ) { return n->next.get ( ); },
+// a null link (unique_ptr or offset_ptr, offset 0 is null) yields nullptr, which ends the chain.
+
+namespace sax {
+
+// Walk a single list, the successor of a node is prefetched before the node is visited, so that the visit
+// overlaps with the load of the next node.
+template<typename Node, typename Next, typename Visit>
+void walk ( Node * node_, Next next_, Visit visit_ ) {
+    while ( node_ ) {
+        Node * next = next_ ( node_ );
+        detail::prefetch ( next );
+        visit_ ( node_ );
+        node_ = next;
+    }
+}
+
+// Walk n_ independent lists, Group of them at a time, in lockstep. Each round advances every active chain by one
+// hop, so up to Group cache misses are in flight at any time. A finished chain is replaced by the next head.
+template<std::size_t Group = 8, typename Node, typename Next, typename Visit>
+void walk ( Node * const * heads_, std::size_t n_, Next next_, Visit visit_ ) {
+    static_assert ( Group > 0, "the group size must be positive" );
+    std::array<Node *, Group> cursor = { };
+    std::size_t active = 0, head = 0;
+    for ( ; active < Group and head < n_; ++head )
+        if ( heads_[ head ] )
+            detail::prefetch ( cursor[ active++ ] = heads_[ head ] );
+    while ( active ) {
+        for ( std::size_t i = 0; i < active; ) {
+            Node * node = cursor[ i ];
+            Node * next = next_ ( node );
+            visit_ ( node );
+            while ( not next and head < n_ )
+                next = heads_[ head++ ];
+            if ( next ) {
+                detail::prefetch ( cursor[ i++ ] = next );
+            }
+            else {
+                cursor[ i ] = cursor[ --active ];
+            }
+        }
+    }
+}
+
+// Descend from root_ as long as step_ ( node, key ) returns a child, returns the last node visited (the match, or
+// the would be parent of key_ on a miss). The child is prefetched as soon as it is known.
+template<typename Node, typename Key, typename Step>
+[[nodiscard]] Node * descend ( Node * root_, Key const & key_, Step step_ ) {
+    Node * last = nullptr;
+    for ( Node * node = root_; node; ) {
+        last = node;
+        node = step_ ( node, key_ );
+        detail::prefetch ( node );
+    }
+    return last;
+}
+
+// Batched lookup, equivalent to result_[ i ] = descend ( root_, keys_[ i ], step_ ) for i in [ 0, n_ ), with Group
+// descents interleaved, so their cache misses overlap instead of serializing.
+template<std::size_t Group = 8, typename Node, typename Key, typename Step>
+void descend ( Node * root_, Key const * keys_, std::size_t n_, Step step_, Node ** result_ ) {
+    static_assert ( Group > 0, "the group size must be positive" );
+    if ( not root_ ) {
+        std::fill ( result_, result_ + n_, nullptr );
+        return;
+    }
+    struct chain {
+        Node * node;
+        std::size_t key;
+    };
+    std::array<chain, Group> cursor;
+    std::size_t active = 0, key = 0;
+    for ( ; active < Group and key < n_; ++key )
+        cursor[ active++ ] = { root_, key };
+    while ( active ) {
+        for ( std::size_t i = 0; i < active; ) {
+            chain & c  = cursor[ i ];
+            Node * next = step_ ( c.node, keys_[ c.key ] );
+            if ( next ) {
+                detail::prefetch ( c.node = next );
+                ++i;
+            }
+            else {
+                result_[ c.key ] = c.node;
+                if ( key < n_ ) {
+                    c = { root_, key++ };
+                    ++i;
+                }
+                else {
+                    c = cursor[ --active ];
+                }
+            }
+        }
+    }
+}
+
+} // namespace sax
@@ -0,0 +1,435 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "offset_ptr.hpp"
+
+namespace sax {
+
+// Links between objects owned by a region, the region destroys them, not the pointer.
+struct no_delete {
+    template<typename T>
+    static void destroy ( T * ) noexcept {}
+    template<typename T, typename Pool>
+    static void destroy ( T *, Pool & ) noexcept {}
+};
+
+enum class traversal { depth_first, breadth_first, van_emde_boas };
+
+// The storage for all slots addressable by offset_ptr<Type, Where>, mapped in one go and installed as their base on
+// the constructing thread (until destruction, the previous base is restored). Objects are bump allocated, slot 0 is
+// never handed out, offset 0 is null. The region owns its objects, links between them are typically
+// offset_ptr<Type, Where, sax::no_delete>. Such a Type is not trivially copyable, so it is only moved as its bytes (by
+// merge and compact, and required by write_region and read_region) if sax::is_trivially_relocatable is specialized
+// for it, template<> struct sax::is_trivially_relocatable<node> : std::true_type {}; which holds if all its members
+// are trivially relocatable (offset_ptr's are).
+
+template<typename Type, typename Where = detail::heap_offset_ptr_pointer>
+class offset_region {
+
+    public:
+    using value_type    = Type;
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using size_type       = std::size_t;
+    using offset_ptr_type = detail::offset_ptr<Type, Where, no_delete>;
+    using offset_type     = typename offset_ptr_type::offset_type;
+
+    static constexpr size_type slots = size_type{ offset_ptr_type::offset_view ( offset_type ( ~0 ) ) } + 1;
+    static constexpr size_type bytes = detail::round_up ( slots * sizeof ( value_type ), detail::page_size );
+
+    static_assert ( alignof ( value_type ) <= detail::page_size, "over-aligned types are not supported" );
+    static_assert ( std::is_same<Where, detail::heap_offset_ptr_pointer>::value,
+                    "stack offsets address the stack of the thread, see sax::stack_arena" );
+
+    explicit offset_region ( placement const & where_ = { } ) :
+        m_map ( bytes, where_ ), m_data ( static_cast<pointer> ( m_map.data ( ) ) ), m_live ( slots / 64 + 1 ) {
+        m_previous = std::exchange ( base_type::ptr, m_data );
+    }
+
+    offset_region ( offset_region const & ) = delete;
+    offset_region & operator= ( offset_region const & ) = delete;
+
+    ~offset_region ( ) noexcept {
+        if constexpr ( not std::is_trivially_destructible<value_type>::value ) {
+            for ( size_type i = 1; i < m_top; ++i )
+                if ( is_live ( i ) )
+                    std::destroy_at ( m_data + i );
+            // Partitions that were not merged.
+            for ( size_type k = 0; k < m_end.size ( ); ++k )
+                std::destroy ( m_data + m_begin[ k ], m_data + m_end[ k ] );
+        }
+        base_type::ptr = m_previous;
+    }
+
+    // Allocation.
+
+    template<typename... Args>
+    [[nodiscard]] pointer construct ( Args &&... args_ ) {
+        if ( m_top == slots )
+            throw std::bad_alloc ( );
+        pointer p = ::new ( static_cast<void *> ( m_data + m_top ) ) value_type ( std::forward<Args> ( args_ )... );
+        set_live ( m_top++ );
+        ++m_size;
+        return p;
+    }
+
+    // The slot is not reused before the next compaction.
+    void destroy ( pointer p_ ) noexcept {
+        std::destroy_at ( p_ );
+        clear_live ( static_cast<size_type> ( p_ - m_data ) );
+        --m_size;
+    }
+
+    // Observers.
+
+    [[nodiscard]] size_type size ( ) const noexcept { return m_size; }
+    [[nodiscard]] size_type top ( ) const noexcept { return m_top; }
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return slots - 1; }
+
+    [[nodiscard]] pointer data ( ) const noexcept { return m_data; }
+    [[nodiscard]] bool contains ( const_pointer p_ ) const noexcept { return m_data < p_ and p_ < m_data + m_top; }
+    // Whether slot i_ (below top) holds an object.
+    [[nodiscard]] bool is_live ( size_type i_ ) const noexcept { return ( m_live[ i_ >> 6 ] >> ( i_ & 63 ) ) & 1; }
+
+    [[nodiscard]] placement_stats const & stats ( ) const noexcept { return m_map.stats ( ); }
+
+    // Parallel construction.
+
+    // Split the unused slots into n_ partitions of equal size, each to be filled by one thread through a partition. All
+    // partitions share the base of the region, so links across partitions are plain offsets. The region itself is not
+    // to be used until merge.
+    void split ( size_type n_ ) {
+        m_begin.resize ( n_ + 1 );
+        for ( size_type k = 0; k < n_; ++k )
+            m_begin[ k ] = m_top + ( slots - m_top ) * k / n_;
+        m_begin[ n_ ] = slots;
+        m_end.assign ( std::begin ( m_begin ), std::end ( m_begin ) - 1 );
+    }
+
+    // The k_-th partition of the split, to be created on the thread that fills it, installs the base of the region on
+    // that thread (until destruction).
+    class partition {
+
+        public:
+        partition ( offset_region & region_, size_type k_ ) noexcept :
+            m_region ( region_ ), m_index ( k_ ), m_top ( region_.m_begin[ k_ ] ), m_last ( region_.m_begin[ k_ + 1 ] ) {
+            m_previous = std::exchange ( base_type::ptr, region_.m_data );
+        }
+
+        partition ( partition const & ) = delete;
+        partition & operator= ( partition const & ) = delete;
+
+        ~partition ( ) noexcept {
+            m_region.m_end[ m_index ] = m_top;
+            base_type::ptr            = m_previous;
+        }
+
+        template<typename... Args>
+        [[nodiscard]] pointer construct ( Args &&... args_ ) {
+            if ( m_top == m_last )
+                throw std::bad_alloc ( );
+            pointer p = ::new ( static_cast<void *> ( m_region.m_data + m_top ) ) value_type ( std::forward<Args> ( args_ )... );
+            ++m_top;
+            return p;
+        }
+
+        [[nodiscard]] size_type size ( ) const noexcept { return m_top - m_region.m_begin[ m_index ]; }
+
+        private:
+        offset_region & m_region;
+        size_type m_index, m_top, m_last;
+        pointer m_previous;
+    };
+
+    // Concatenate the partitions (after all of them have been destroyed), at the end of the objects constructed before
+    // the split. The offsets (in the roots, and in the links that links_ ( Type &, f ) passes to f) are rewritten first,
+    // in parallel, one thread per partition, then the partitions are moved down in order, so that a partition never
+    // overwrites one that still has to move.
+    template<typename Root, typename Links>
+    void merge ( Root * roots_, size_type n_, Links links_ ) {
+        static_assert ( std::is_nothrow_move_constructible<value_type>::value or is_trivially_relocatable_v<value_type>,
+                        "relocation must not throw" );
+        size_type const parts = m_end.size ( );
+        if ( not parts )
+            return;
+        std::vector<size_type> start ( parts + 1, m_begin[ 0 ] );
+        for ( size_type k = 0; k < parts; ++k )
+            start[ k + 1 ] = start[ k ] + ( m_end[ k ] - m_begin[ k ] );
+        auto forward = [ this, &start, parts ] ( size_type v_ ) noexcept -> offset_type {
+            if ( v_ < m_begin[ 0 ] )
+                return static_cast<offset_type> ( v_ );
+            size_type const k = static_cast<size_type> (
+                std::upper_bound ( std::begin ( m_begin ), std::begin ( m_begin ) + parts, v_ ) - std::begin ( m_begin ) - 1 );
+            return v_ < m_end[ k ] ? static_cast<offset_type> ( v_ - m_begin[ k ] + start[ k ] ) : offset_type{ 0 };
+        };
+        auto rewrite = [ &forward ] ( auto & link_ ) noexcept {
+            offset_type const o = link_.raw_offset ( ), v = offset_ptr_type::offset_view ( o );
+            link_.set_raw_offset ( static_cast<offset_type> ( ( o ^ v ) | forward ( v ) ) );
+        };
+        auto fix = [ this, &links_, &rewrite ] ( size_type first_, size_type last_ ) {
+            for ( size_type i = first_; i < last_; ++i )
+                links_ ( m_data[ i ], rewrite );
+        };
+        std::vector<std::thread> threads;
+        threads.reserve ( parts - 1 );
+        for ( size_type k = 1; k < parts; ++k )
+            threads.emplace_back ( fix, m_begin[ k ], m_end[ k ] );
+        fix ( m_begin[ 0 ], m_end[ 0 ] );
+        for ( size_type i = 1; i < m_begin[ 0 ]; ++i )
+            if ( is_live ( i ) )
+                links_ ( m_data[ i ], rewrite );
+        for ( size_type i = 0; i < n_; ++i )
+            rewrite ( roots_[ i ] );
+        for ( std::thread & t : threads )
+            t.join ( );
+        for ( size_type k = 1; k < parts; ++k ) {
+            if ( start[ k ] == m_begin[ k ] )
+                continue;
+            if constexpr ( is_trivially_relocatable_v<value_type> ) {
+                std::memmove ( static_cast<void *> ( m_data + start[ k ] ), static_cast<void const *> ( m_data + m_begin[ k ] ),
+                               ( m_end[ k ] - m_begin[ k ] ) * sizeof ( value_type ) );
+            }
+            else {
+                for ( size_type i = m_begin[ k ], j = start[ k ]; i < m_end[ k ]; ++i, ++j )
+                    relocate ( m_data + i, m_data + j );
+            }
+        }
+        for ( size_type i = m_begin[ 0 ]; i < start[ parts ]; ++i )
+            set_live ( i );
+        m_size += start[ parts ] - m_begin[ 0 ];
+        m_top = start[ parts ];
+        m_begin.clear ( );
+        m_end.clear ( );
+        release_tail ( );
+    }
+
+    // Relocate the objects reachable from the n_ roots to the front of the region, in the given traversal order,
+    // rewrite all offsets (in the roots, and in the links that links_ ( Type &, f ) passes to f), destroy the
+    // unreachable objects and return the pages of the freed tail to the os. Links to unreachable objects become null.
+    // The van Emde Boas order lays out the breadth first spanning tree of the links, so shared nodes, parent links and
+    // cycles are followed once. Returns the number of objects kept.
+    template<typename Root, typename Links>
+    size_type compact ( Root * roots_, size_type n_, Links links_, traversal order_ = traversal::depth_first ) {
+        static_assert ( std::is_nothrow_move_constructible<value_type>::value or is_trivially_relocatable_v<value_type>,
+                        "relocation must not throw" );
+        std::vector<offset_type> const order = visit_order ( roots_, n_, links_, order_ );
+        size_type const live                 = order.size ( );
+        // The forwarding table, old offset to new offset, 0 (null) maps to 0.
+        std::vector<offset_type> forward ( slots, offset_type{ 0 } );
+        for ( size_type i = 0; i < live; ++i )
+            forward[ order[ i ] ] = static_cast<offset_type> ( i + 1 );
+        if constexpr ( not std::is_trivially_destructible<value_type>::value ) {
+            for ( size_type i = 1; i < m_top; ++i )
+                if ( is_live ( i ) and not forward[ i ] )
+                    std::destroy_at ( m_data + i );
+        }
+        // Source and destination slots overlap, go through a scratch buffer.
+        std::unique_ptr<storage[]> scratch ( new storage[ live ] );
+        pointer const buffer = reinterpret_cast<pointer> ( scratch.get ( ) );
+        for ( size_type i = 0; i < live; ++i )
+            relocate ( m_data + order[ i ], buffer + i );
+        auto rewrite = [ &forward ] ( auto & link_ ) noexcept {
+            offset_type const o = link_.raw_offset ( ), v = offset_ptr_type::offset_view ( o );
+            link_.set_raw_offset ( static_cast<offset_type> ( ( o ^ v ) | forward[ v ] ) );
+        };
+        for ( size_type i = 0; i < live; ++i )
+            links_ ( buffer[ i ], rewrite );
+        for ( size_type i = 0; i < n_; ++i )
+            rewrite ( roots_[ i ] );
+        for ( size_type i = 0; i < live; ++i )
+            relocate ( buffer + i, m_data + i + 1 );
+        std::fill ( std::begin ( m_live ), std::end ( m_live ), std::uint64_t{ 0 } );
+        for ( size_type i = 1; i <= live; ++i )
+            set_live ( i );
+        m_size = live;
+        m_top  = live + 1;
+        release_tail ( );
+        return live;
+    }
+
+    private:
+    using base_type = detail::offset_ptr_base<Type, Where>;
+    using storage   = std::aligned_storage_t<sizeof ( value_type ), alignof ( value_type )>;
+
+    detail::mapping m_map;
+    pointer m_data;
+    pointer m_previous;
+    size_type m_top  = 1;
+    size_type m_size = 0;
+    std::vector<std::uint64_t> m_live;
+    std::vector<size_type> m_begin, m_end; // The bounds of the partitions of a split, [ m_begin[ k ], m_end[ k ] ) is used.
+
+    void set_live ( size_type i_ ) noexcept { m_live[ i_ >> 6 ] |= std::uint64_t{ 1 } << ( i_ & 63 ); }
+    void clear_live ( size_type i_ ) noexcept { m_live[ i_ >> 6 ] &= ~( std::uint64_t{ 1 } << ( i_ & 63 ) ); }
+
+    static void relocate ( pointer from_, pointer to_ ) noexcept {
+        if constexpr ( is_trivially_relocatable_v<value_type> ) {
+            std::memcpy ( static_cast<void *> ( to_ ), static_cast<void const *> ( from_ ), sizeof ( value_type ) );
+        }
+        else {
+            ::new ( static_cast<void *> ( to_ ) ) value_type ( std::move ( *from_ ) );
+            std::destroy_at ( from_ );
+        }
+    }
+
+    void release_tail ( ) noexcept {
+        size_type const used = detail::round_up ( m_top * sizeof ( value_type ), detail::page_size );
+        if ( used < bytes )
+            detail::os::discard ( reinterpret_cast<char *> ( m_data ) + used, bytes - used );
+    }
+
+    template<typename Links>
+    void children ( offset_type o_, Links & links_, std::vector<offset_type> & out_ ) {
+        out_.clear ( );
+        links_ ( m_data[ o_ ], [ this, &out_ ] ( auto & link_ ) {
+            offset_type const v = offset_ptr_type::offset_view ( link_.raw_offset ( ) );
+            if ( v and v < m_top and is_live ( v ) )
+                out_.push_back ( v );
+        } );
+    }
+
+    template<typename Root, typename Links>
+    [[nodiscard]] std::vector<offset_type> visit_order ( Root * roots_, size_type n_, Links & links_, traversal order_ ) {
+        std::vector<offset_type> order, next, kids;
+        std::vector<bool> seen ( slots );
+        order.reserve ( m_size );
+        auto emit = [ & ] ( offset_type o_ ) {
+            if ( seen[ o_ ] )
+                return false;
+            seen[ o_ ] = true;
+            order.push_back ( o_ );
+            return true;
+        };
+        std::vector<offset_type> roots;
+        for ( size_type i = 0; i < n_; ++i )
+            if ( offset_type const v = offset_ptr_type::offset_view ( roots_[ i ].raw_offset ( ) ); v and v < m_top and is_live ( v ) )
+                roots.push_back ( v );
+        switch ( order_ ) {
+            case traversal::depth_first: {
+                std::vector<offset_type> stack ( std::rbegin ( roots ), std::rend ( roots ) );
+                while ( not stack.empty ( ) ) {
+                    offset_type const o = stack.back ( );
+                    stack.pop_back ( );
+                    if ( emit ( o ) ) {
+                        children ( o, links_, kids );
+                        stack.insert ( std::end ( stack ), std::rbegin ( kids ), std::rend ( kids ) );
+                    }
+                }
+            } break;
+            case traversal::breadth_first: {
+                for ( offset_type o : roots )
+                    emit ( o );
+                for ( size_type i = 0; i < order.size ( ); ++i ) {
+                    children ( order[ i ], links_, kids );
+                    for ( offset_type k : kids )
+                        emit ( k );
+                }
+            } break;
+            case traversal::van_emde_boas: {
+                std::vector<offset_type> parent ( slots, offset_type{ 0 } );
+                std::vector<bool> reached ( slots );
+                for ( offset_type o : roots )
+                    if ( not reached[ o ] ) {
+                        size_type const h = spanning_tree ( o, links_, parent, reached, next, kids );
+                        van_emde_boas ( o, h, links_, parent, emit, next, kids );
+                    }
+            } break;
+        }
+        return order;
+    }
+
+    // The breadth first spanning tree at root_, of the nodes not reached before, parent_[ v ] is the node that reached
+    // v first. Returns the number of levels.
+    template<typename Links>
+    [[nodiscard]] size_type spanning_tree ( offset_type root_, Links & links_, std::vector<offset_type> & parent_,
+                                            std::vector<bool> & reached_, std::vector<offset_type> & next_,
+                                            std::vector<offset_type> & kids_ ) {
+        std::vector<offset_type> level = { root_ };
+        reached_[ root_ ]              = true;
+        size_type h                    = 0;
+        for ( ; not level.empty ( ); ++h ) {
+            next_.clear ( );
+            for ( offset_type o : level ) {
+                children ( o, links_, kids_ );
+                for ( offset_type k : kids_ )
+                    if ( not reached_[ k ] ) {
+                        reached_[ k ] = true;
+                        parent_[ k ]  = o;
+                        next_.push_back ( k );
+                    }
+            }
+            level.swap ( next_ );
+        }
+        return h;
+    }
+
+    // The children of o_ in the spanning tree.
+    template<typename Links>
+    void tree_children ( offset_type o_, Links & links_, std::vector<offset_type> const & parent_, std::vector<offset_type> & out_ ) {
+        children ( o_, links_, out_ );
+        out_.erase ( std::remove_if ( std::begin ( out_ ), std::end ( out_ ), [ & ] ( offset_type k_ ) { return parent_[ k_ ] != o_; } ),
+                     std::end ( out_ ) );
+    }
+
+    // Lay out the top half of the levels of the subtree at root_, recursively, then each of the subtrees hanging off
+    // it, recursively.
+    template<typename Links, typename Emit>
+    void van_emde_boas ( offset_type root_, size_type levels_, Links & links_, std::vector<offset_type> const & parent_,
+                         Emit & emit_, std::vector<offset_type> & next_, std::vector<offset_type> & kids_ ) {
+        if ( levels_ <= 1 ) {
+            emit_ ( root_ );
+            return;
+        }
+        size_type const top = levels_ / 2;
+        van_emde_boas ( root_, top, links_, parent_, emit_, next_, kids_ );
+        std::vector<offset_type> frontier = { root_ };
+        for ( size_type d = 0; d < top and not frontier.empty ( ); ++d ) {
+            next_.clear ( );
+            for ( offset_type o : frontier ) {
+                tree_children ( o, links_, parent_, kids_ );
+                next_.insert ( std::end ( next_ ), std::begin ( kids_ ), std::end ( kids_ ) );
+            }
+            frontier.swap ( next_ );
+        }
+        for ( offset_type o : frontier )
+            van_emde_boas ( o, levels_ - top, links_, parent_, emit_, next_, kids_ );
+    }
+};
+
+} // namespace sax
@@ -0,0 +1,263 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "offset_region.hpp"
+
+// Streaming (de)serialization of the object graph of an offset_region. The live objects are written in region order,
+// each as its bytes without its links, followed by its links, as varints of the distance to their target in that
+// order (zigzag encoded, 0 is null). As the reader constructs the objects in the same order, at consecutive
+// slots, a link is rebuilt as its own slot plus the distance, in any region, without a table of old to new offsets.
+//
+// Output goes to sink_ ( char const * data, std::size_t size ) in chunks, input comes from
+// source_ ( char * data, std::size_t size ), which returns the number of bytes read, 0 at the end. The links of an
+// object are the ones that links_ ( Type &, f ) passes to f, as for offset_region::compact, the same members for every
+// object. Objects are moved as their bytes, so Type must be trivially relocatable (see offset_region), and apart from
+// its links, plain data.
+
+namespace sax {
+
+namespace detail {
+
+inline constexpr char region_stream_magic[ 4 ] = { 's', 'x', 'r', 'g' };
+inline constexpr std::uint64_t region_stream_version = 2;
+
+[[nodiscard]] constexpr std::uint64_t zigzag ( std::int64_t v_ ) noexcept {
+    return ( static_cast<std::uint64_t> ( v_ ) << 1 ) ^ static_cast<std::uint64_t> ( v_ >> 63 );
+}
+[[nodiscard]] constexpr std::int64_t unzigzag ( std::uint64_t v_ ) noexcept {
+    return static_cast<std::int64_t> ( v_ >> 1 ) ^ -static_cast<std::int64_t> ( v_ & 1 );
+}
+
+// The byte ranges [ first, second ) of a Type that are not links, in order.
+template<typename Type, typename Links>
+[[nodiscard]] std::vector<std::pair<std::size_t, std::size_t>> plain_ranges ( Links & links_ ) {
+    std::aligned_storage_t<sizeof ( Type ), alignof ( Type )> buffer;
+    std::memset ( &buffer, 0, sizeof ( Type ) );
+    std::vector<std::pair<std::size_t, std::size_t>> links, plain;
+    links_ ( *std::launder ( reinterpret_cast<Type *> ( &buffer ) ), [ & ] ( auto & link_ ) {
+        std::size_t const b = static_cast<std::size_t> ( reinterpret_cast<char const *> ( std::addressof ( link_ ) ) -
+                                                         reinterpret_cast<char const *> ( &buffer ) );
+        links.emplace_back ( b, b + sizeof ( link_ ) );
+    } );
+    std::sort ( std::begin ( links ), std::end ( links ) );
+    std::size_t at = 0;
+    for ( auto const & [ b, e ] : links ) {
+        if ( at < b )
+            plain.emplace_back ( at, b );
+        at = std::max ( at, e );
+    }
+    if ( at < sizeof ( Type ) )
+        plain.emplace_back ( at, sizeof ( Type ) );
+    return plain;
+}
+
+template<typename Sink>
+class chunk_writer {
+
+    public:
+    chunk_writer ( Sink & sink_, std::size_t chunk_ ) : m_sink ( sink_ ) { m_buffer.reserve ( chunk_ ? chunk_ : 1 ); }
+
+    void bytes ( void const * p_, std::size_t n_ ) {
+        char const * p = static_cast<char const *> ( p_ );
+        while ( n_ ) {
+            std::size_t const n = std::min ( n_, m_buffer.capacity ( ) - m_buffer.size ( ) );
+            m_buffer.insert ( std::end ( m_buffer ), p, p + n );
+            p += n;
+            n_ -= n;
+            if ( m_buffer.size ( ) == m_buffer.capacity ( ) )
+                flush ( );
+        }
+    }
+
+    // LEB128.
+    void varint ( std::uint64_t v_ ) {
+        char b[ 10 ];
+        std::size_t n = 0;
+        for ( ; v_ >= 0x80; v_ >>= 7 )
+            b[ n++ ] = static_cast<char> ( v_ | 0x80 );
+        b[ n++ ] = static_cast<char> ( v_ );
+        bytes ( b, n );
+    }
+
+    void flush ( ) {
+        if ( not m_buffer.empty ( ) )
+            m_sink ( m_buffer.data ( ), m_buffer.size ( ) );
+        m_buffer.clear ( );
+    }
+
+    private:
+    Sink & m_sink;
+    std::vector<char> m_buffer;
+};
+
+template<typename Source>
+class chunk_reader {
+
+    public:
+    chunk_reader ( Source & source_, std::size_t chunk_ ) : m_source ( source_ ), m_buffer ( chunk_ ? chunk_ : 1 ) {}
+
+    void bytes ( void * p_, std::size_t n_ ) {
+        char * p = static_cast<char *> ( p_ );
+        while ( n_ ) {
+            if ( m_begin == m_end )
+                refill ( );
+            std::size_t const n = std::min ( n_, m_end - m_begin );
+            std::memcpy ( p, m_buffer.data ( ) + m_begin, n );
+            m_begin += n;
+            p += n;
+            n_ -= n;
+        }
+    }
+
+    [[nodiscard]] std::uint64_t varint ( ) {
+        std::uint64_t v = 0;
+        for ( int shift = 0; shift < 64; shift += 7 ) {
+            if ( m_begin == m_end )
+                refill ( );
+            std::uint64_t const b = static_cast<unsigned char> ( m_buffer[ m_begin++ ] );
+            v |= ( b & 0x7F ) << shift;
+            if ( not( b & 0x80 ) )
+                return v;
+        }
+        throw std::runtime_error ( "read_region: malformed varint" );
+    }
+
+    private:
+    Source & m_source;
+    std::vector<char> m_buffer;
+    std::size_t m_begin = 0, m_end = 0;
+
+    void refill ( ) {
+        m_begin = 0;
+        m_end   = m_source ( m_buffer.data ( ), m_buffer.size ( ) );
+        if ( not m_end )
+            throw std::runtime_error ( "read_region: unexpected end of stream" );
+    }
+};
+
+} // namespace detail
+
+// Write the live objects of region_ and the n_ roots.
+template<typename Type, typename Root, typename Links, typename Sink>
+void write_region ( offset_region<Type> const & region_, Root const * roots_, std::size_t n_, Links links_, Sink sink_,
+                    std::size_t chunk_ = 65'536 ) {
+    static_assert ( is_trivially_relocatable_v<Type>, "objects are written as their bytes, see sax::is_trivially_relocatable" );
+    using region_type = offset_region<Type>;
+    using offset_type = typename region_type::offset_type;
+    using link_type   = typename region_type::offset_ptr_type;
+    std::size_t const top = region_.top ( );
+    // The position of each live object in the stream, from 1, 0 for the dead (links to them become null).
+    std::vector<offset_type> rank ( top, offset_type{ 0 } );
+    std::size_t n = 0;
+    for ( std::size_t i = 1; i < top; ++i )
+        if ( region_.is_live ( i ) )
+            rank[ i ] = static_cast<offset_type> ( ++n );
+    auto encode = [ & ] ( offset_type o_, std::size_t from_ ) -> std::uint64_t {
+        offset_type const v = link_type::offset_view ( o_ );
+        if ( not v or v >= top or not rank[ v ] )
+            return 0;
+        std::int64_t const distance = static_cast<std::int64_t> ( rank[ v ] ) - static_cast<std::int64_t> ( from_ );
+        // The flag bits (the weak bit) are kept in the low bit.
+        return ( ( detail::zigzag ( distance ) + 1 ) << 1 ) | static_cast<std::uint64_t> ( ( o_ ^ v ) != 0 );
+    };
+    detail::chunk_writer<Sink> out ( sink_, chunk_ );
+    out.bytes ( detail::region_stream_magic, sizeof ( detail::region_stream_magic ) );
+    out.varint ( detail::region_stream_version );
+    out.varint ( sizeof ( Type ) );
+    out.varint ( n );
+    auto const plain = detail::plain_ranges<Type> ( links_ );
+    for ( std::size_t i = 1; i < top; ++i ) {
+        if ( not rank[ i ] )
+            continue;
+        Type & object = region_.data ( )[ i ];
+        for ( auto const & [ b, e ] : plain )
+            out.bytes ( reinterpret_cast<char const *> ( std::addressof ( object ) ) + b, e - b );
+        links_ ( object, [ & ] ( auto & link_ ) { out.varint ( encode ( link_.raw_offset ( ), rank[ i ] ) ); } );
+    }
+    // Roots are relative to a virtual slot 0, before the first object.
+    out.varint ( n_ );
+    for ( std::size_t i = 0; i < n_; ++i )
+        out.varint ( encode ( roots_[ i ].raw_offset ( ), 0 ) );
+    out.flush ( );
+}
+
+// Append the objects of a stream written by write_region to region_, and rebuild the n_ roots, returns the number of
+// objects read.
+template<typename Type, typename Root, typename Links, typename Source>
+std::size_t read_region ( offset_region<Type> & region_, Root * roots_, std::size_t n_, Links links_, Source source_,
+                          std::size_t chunk_ = 65'536 ) {
+    static_assert ( is_trivially_relocatable_v<Type>, "objects are read as their bytes, see sax::is_trivially_relocatable" );
+    using offset_type = typename offset_region<Type>::offset_type;
+    using link_type   = typename offset_region<Type>::offset_ptr_type;
+    detail::chunk_reader<Source> in ( source_, chunk_ );
+    char magic[ sizeof ( detail::region_stream_magic ) ];
+    in.bytes ( magic, sizeof ( magic ) );
+    if ( std::memcmp ( magic, detail::region_stream_magic, sizeof ( magic ) ) or in.varint ( ) != detail::region_stream_version )
+        throw std::runtime_error ( "read_region: not a region stream" );
+    if ( in.varint ( ) != sizeof ( Type ) )
+        throw std::runtime_error ( "read_region: object size mismatch" );
+    std::uint64_t const n = in.varint ( );
+    if ( n > region_.capacity ( ) - ( region_.top ( ) - 1 ) )
+        throw std::runtime_error ( "read_region: the objects do not fit in the region" );
+    std::int64_t const first = static_cast<std::int64_t> ( region_.top ( ) ); // The slot of object 1.
+    auto decode = [ & ] ( std::uint64_t l_, std::int64_t from_ ) -> offset_type {
+        if ( not l_ )
+            return 0;
+        std::int64_t const target = from_ + detail::unzigzag ( ( l_ >> 1 ) - 1 );
+        if ( target < first or target >= first + static_cast<std::int64_t> ( n ) )
+            throw std::runtime_error ( "read_region: link out of range" );
+        offset_type const flags = ( l_ & 1 ) ? static_cast<offset_type> ( ~link_type::offset_view ( offset_type ( ~0 ) ) ) : offset_type{ 0 };
+        return static_cast<offset_type> ( target ) | flags;
+    };
+    auto const plain = detail::plain_ranges<Type> ( links_ );
+    std::aligned_storage_t<sizeof ( Type ), alignof ( Type )> buffer;
+    for ( std::uint64_t k = 0; k < n; ++k ) {
+        for ( auto const & [ b, e ] : plain )
+            in.bytes ( reinterpret_cast<char *> ( &buffer ) + b, e - b );
+        Type & object           = *std::launder ( reinterpret_cast<Type *> ( &buffer ) );
+        std::int64_t const self = first + static_cast<std::int64_t> ( k );
+        links_ ( object, [ & ] ( auto & link_ ) { link_.set_raw_offset ( decode ( in.varint ( ), self ) ); } );
+        // Relocated into the region, the bytes left behind are not destroyed.
+        (void) region_.construct ( std::move ( object ) );
+    }
+    if ( in.varint ( ) != n_ )
+        throw std::runtime_error ( "read_region: root count mismatch" );
+    for ( std::size_t i = 0; i < n_; ++i )
+        roots_[ i ].set_raw_offset ( decode ( in.varint ( ), first - 1 ) );
+    return static_cast<std::size_t> ( n );
+}
+
+} // namespace sax
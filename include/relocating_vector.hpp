@@ -0,0 +1,240 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "offset_ptr.hpp"
+
+namespace sax {
+
+// A vector that grows by memcpy (std::realloc, where the alignment permits) if its value_type is trivially
+// relocatable, instead of move constructing and destroying every element, as std::vector does.
+
+template<typename T>
+class relocating_vector {
+
+    public:
+    using value_type = T;
+
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using reference       = value_type &;
+    using const_reference = value_type const &;
+    using rv_reference    = value_type &&;
+
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    using iterator       = pointer;
+    using const_iterator = const_pointer;
+
+    static constexpr bool relocatable = is_trivially_relocatable_v<value_type>;
+
+    relocating_vector ( ) noexcept = default;
+    relocating_vector ( relocating_vector const & ) = delete;
+    relocating_vector ( relocating_vector && moving_ ) noexcept :
+        m_data ( std::exchange ( moving_.m_data, nullptr ) ), m_size ( std::exchange ( moving_.m_size, 0 ) ),
+        m_capacity ( std::exchange ( moving_.m_capacity, 0 ) ) {}
+
+    ~relocating_vector ( ) noexcept {
+        clear ( );
+        deallocate ( m_data );
+    }
+
+    relocating_vector & operator= ( relocating_vector const & ) = delete;
+    relocating_vector & operator= ( relocating_vector && moving_ ) noexcept {
+        relocating_vector tmp ( std::move ( moving_ ) );
+        swap ( tmp );
+        return *this;
+    }
+
+    void swap ( relocating_vector & other_ ) noexcept {
+        std::swap ( m_data, other_.m_data );
+        std::swap ( m_size, other_.m_size );
+        std::swap ( m_capacity, other_.m_capacity );
+    }
+
+    // Size.
+
+    [[nodiscard]] size_type size ( ) const noexcept { return m_size; }
+    [[nodiscard]] size_type capacity ( ) const noexcept { return m_capacity; }
+    [[nodiscard]] bool empty ( ) const noexcept { return not m_size; }
+
+    void reserve ( size_type n_ ) {
+        if ( n_ > m_capacity )
+            reallocate ( n_ );
+    }
+
+    void clear ( ) noexcept {
+        if constexpr ( not std::is_trivially_destructible<value_type>::value )
+            std::destroy ( begin ( ), end ( ) );
+        m_size = 0;
+    }
+
+    // Modifiers.
+
+    template<typename... Args>
+    reference emplace_back ( Args &&... args_ ) {
+        if ( m_size == m_capacity )
+            return emplace_back_grow ( std::forward<Args> ( args_ )... );
+        pointer p = ::new ( static_cast<void *> ( m_data + m_size ) ) value_type ( std::forward<Args> ( args_ )... );
+        ++m_size;
+        return *p;
+    }
+
+    void push_back ( rv_reference value_ ) { emplace_back ( std::move ( value_ ) ); }
+    void push_back ( const_reference value_ ) { emplace_back ( value_ ); }
+
+    void pop_back ( ) noexcept {
+        --m_size;
+        std::destroy_at ( m_data + m_size );
+    }
+
+    // Element access.
+
+    [[nodiscard]] const_pointer data ( ) const noexcept { return m_data; }
+    [[nodiscard]] pointer data ( ) noexcept { return m_data; }
+
+    [[nodiscard]] const_reference operator[] ( size_type const i_ ) const noexcept { return m_data[ i_ ]; }
+    [[nodiscard]] reference operator[] ( size_type const i_ ) noexcept { return m_data[ i_ ]; }
+
+    [[nodiscard]] const_reference at ( size_type const i_ ) const {
+        if ( i_ < m_size )
+            return m_data[ i_ ];
+        else
+            throw std::runtime_error ( "relocating_vector: index out of bounds" );
+    }
+    [[nodiscard]] reference at ( size_type const i_ ) { return const_cast<reference> ( std::as_const ( *this ).at ( i_ ) ); }
+
+    [[nodiscard]] const_reference front ( ) const noexcept { return *m_data; }
+    [[nodiscard]] reference front ( ) noexcept { return *m_data; }
+
+    [[nodiscard]] const_reference back ( ) const noexcept { return m_data[ m_size - 1 ]; }
+    [[nodiscard]] reference back ( ) noexcept { return m_data[ m_size - 1 ]; }
+
+    // Iterators.
+
+    [[nodiscard]] const_iterator begin ( ) const noexcept { return m_data; }
+    [[nodiscard]] const_iterator cbegin ( ) const noexcept { return begin ( ); }
+    [[nodiscard]] iterator begin ( ) noexcept { return m_data; }
+
+    [[nodiscard]] const_iterator end ( ) const noexcept { return m_data + m_size; }
+    [[nodiscard]] const_iterator cend ( ) const noexcept { return end ( ); }
+    [[nodiscard]] iterator end ( ) noexcept { return m_data + m_size; }
+
+    private:
+    pointer m_data       = nullptr;
+    size_type m_size     = 0;
+    size_type m_capacity = 0;
+
+    static constexpr bool use_realloc = relocatable and alignof ( value_type ) <= alignof ( std::max_align_t );
+
+    using storage = std::aligned_storage_t<sizeof ( value_type ), alignof ( value_type )>;
+
+    [[nodiscard]] size_type grow ( ) const noexcept { return std::max ( size_type{ 4 }, m_capacity + m_capacity / 2 ); }
+
+    // The arguments may refer to an element (v.push_back ( v[ 0 ] )), so the new element is constructed before the old
+    // storage is released, aside and relocated in afterwards if value_type is trivially relocatable (that keeps the
+    // realloc), or directly in the new storage if not.
+    template<typename... Args>
+    reference emplace_back_grow ( Args &&... args_ ) {
+        size_type const n = grow ( );
+        if constexpr ( relocatable ) {
+            storage tmp;
+            pointer const t = ::new ( static_cast<void *> ( &tmp ) ) value_type ( std::forward<Args> ( args_ )... );
+            try {
+                reallocate ( n );
+            }
+            catch ( ... ) {
+                std::destroy_at ( t );
+                throw;
+            }
+            std::memcpy ( static_cast<void *> ( m_data + m_size ), static_cast<void const *> ( t ), sizeof ( value_type ) );
+        }
+        else {
+            pointer const p = allocate ( n );
+            try {
+                ::new ( static_cast<void *> ( p + m_size ) ) value_type ( std::forward<Args> ( args_ )... );
+            }
+            catch ( ... ) {
+                deallocate ( p );
+                throw;
+            }
+            std::uninitialized_move ( begin ( ), end ( ), p );
+            std::destroy ( begin ( ), end ( ) );
+            deallocate ( m_data );
+            m_data     = p;
+            m_capacity = n;
+        }
+        return m_data[ m_size++ ];
+    }
+
+    void reallocate ( size_type n_ ) {
+        if constexpr ( use_realloc ) {
+            void * p = std::realloc ( static_cast<void *> ( m_data ), n_ * sizeof ( value_type ) );
+            if ( not p )
+                throw std::bad_alloc ( );
+            m_data = static_cast<pointer> ( p );
+        }
+        else {
+            pointer p = allocate ( n_ );
+            if constexpr ( relocatable ) {
+                if ( m_size )
+                    std::memcpy ( static_cast<void *> ( p ), static_cast<void const *> ( m_data ), m_size * sizeof ( value_type ) );
+            }
+            else {
+                std::uninitialized_move ( begin ( ), end ( ), p );
+                std::destroy ( begin ( ), end ( ) );
+            }
+            deallocate ( m_data );
+            m_data = p;
+        }
+        m_capacity = n_;
+    }
+
+    [[nodiscard]] static pointer allocate ( size_type n_ ) {
+        return static_cast<pointer> ( ::operator new ( n_ * sizeof ( value_type ), std::align_val_t{ alignof ( value_type ) } ) );
+    }
+
+    static void deallocate ( pointer p_ ) noexcept {
+        if constexpr ( use_realloc )
+            std::free ( static_cast<void *> ( p_ ) );
+        else
+            ::operator delete ( static_cast<void *> ( p_ ), std::align_val_t{ alignof ( value_type ) } );
+    }
+};
+
+} // namespace sax
@@ -0,0 +1,411 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "offset_ptr.hpp"
+
+// Shared ownership in one allocation, the object and its counts, with biased reference counting (Choi et al. 2018).
+// The thread that creates an object owns its biased count, which it updates without atomics, other threads update a
+// shared, atomic count. When the biased count drops to zero the two are merged, and from then on all threads use the
+// shared count. A reference created on the owner and released elsewhere drives the shared count negative, the object
+// is then queued on the owner, which merges it on its next make_shared (or sax::merge_shared ( ), or its exit). A
+// queued object is only disposed by that merge (or after it), the queue refers to it until then.
+//
+// sax::shared_ptr is 8 bytes, sax::shared_offset_ptr is 2, an offset relative to the base of a
+// sax::shared_offset_pool<T>, installed on the thread that builds it, and on other threads by a
+// sax::shared_offset_pool_attachment<T>. The objects always live in the pool (make_shared_offset throws if none is
+// installed), which they record, the last release on another thread frees them through its remote free list. The
+// objects queued on the owner must have been merged before the pool is destroyed.
+
+namespace sax {
+
+namespace detail {
+
+class brc_owner;
+
+struct shared_block_base {
+
+    static constexpr std::intptr_t merged = 1, queued = 2, one = 4; // The shared count is in the bits above the flags.
+
+    std::atomic<std::intptr_t> shared = { 0 };
+    std::uint32_t biased              = 1;
+    brc_owner * const owner;
+    void ( *const destroy ) ( shared_block_base * ) noexcept;
+
+    shared_block_base ( brc_owner * owner_, void ( *destroy_ ) ( shared_block_base * ) noexcept ) noexcept :
+        owner ( owner_ ), destroy ( destroy_ ) {}
+
+    [[nodiscard]] inline bool is_biased ( ) const noexcept;
+
+    void retain ( ) noexcept {
+        if ( is_biased ( ) )
+            ++biased;
+        else
+            shared.fetch_add ( one, std::memory_order_relaxed );
+    }
+
+    inline void release ( ) noexcept;
+
+    // Destroy the object, and drop its reference to the owner's record.
+    inline void dispose ( ) noexcept;
+
+    // Fold the biased count into the shared count (the first time), and if dequeue_, drop the queued flag, returns true
+    // if that leaves no references and the object is not queued. Only called by the owner, or when the owner has exited.
+    [[nodiscard]] bool merge ( bool dequeue_ = false ) noexcept {
+        std::intptr_t add = static_cast<std::intptr_t> ( std::exchange ( biased, 0u ) ) * one;
+        if ( not( shared.load ( std::memory_order_relaxed ) & merged ) )
+            add += merged;
+        if ( dequeue_ )
+            add -= queued;
+        std::intptr_t const s = shared.fetch_add ( add, std::memory_order_acq_rel ) + add;
+        return not( s >> 2 ) and not( s & queued );
+    }
+};
+
+// The per thread side of biased reference counting, the queue of objects to merge. The record outlives its thread as
+// long as there are objects that refer to it, those are then merged by the thread that releases them.
+class brc_owner {
+
+    public:
+    // The record of this thread, nullptr if this thread has not created any objects.
+    inline static thread_local brc_owner * current = nullptr;
+
+    [[nodiscard]] static brc_owner * local ( ) {
+        static thread_local holder h;
+        return h.record;
+    }
+
+    // Called by a non-owner that took the shared count below zero.
+    void enqueue ( shared_block_base * b_ ) noexcept {
+        bool dead;
+        {
+            std::lock_guard<std::mutex> lock ( m_mutex );
+            if ( not( dead = not m_alive ) ) {
+                m_queue.push_back ( b_ );
+                m_pending.store ( true, std::memory_order_release );
+            }
+            else if ( not b_->merge ( true ) ) {
+                return;
+            }
+        }
+        if ( dead )
+            b_->dispose ( );
+    }
+
+    // Merge the queued objects, on the owning thread.
+    void drain ( ) noexcept {
+        while ( m_pending.load ( std::memory_order_acquire ) ) {
+            std::vector<shared_block_base *> queue;
+            {
+                std::lock_guard<std::mutex> lock ( m_mutex );
+                queue.swap ( m_queue );
+                m_pending.store ( false, std::memory_order_relaxed );
+            }
+            merge ( queue );
+        }
+    }
+
+    void ref ( ) noexcept { m_references.fetch_add ( 1, std::memory_order_relaxed ); }
+    void unref ( ) noexcept {
+        if ( m_references.fetch_sub ( 1, std::memory_order_acq_rel ) == 1 )
+            delete this;
+    }
+
+    private:
+    struct holder {
+        brc_owner * record;
+        holder ( ) : record ( new brc_owner ) { current = record; }
+        ~holder ( ) noexcept {
+            std::vector<shared_block_base *> queue;
+            {
+                std::lock_guard<std::mutex> lock ( record->m_mutex );
+                record->m_alive = false;
+                queue.swap ( record->m_queue );
+            }
+            // From here on this thread releases through the shared count, like any other thread.
+            current = nullptr;
+            merge ( queue );
+            record->unref ( );
+        }
+    };
+
+    std::mutex m_mutex;
+    std::vector<shared_block_base *> m_queue; // Guarded by m_mutex.
+    std::atomic<bool> m_pending           = { false };
+    std::atomic<std::size_t> m_references = { 1 };    // The thread, and its objects.
+    bool m_alive                          = true;     // Guarded by m_mutex.
+
+    static void merge ( std::vector<shared_block_base *> & queue_ ) noexcept {
+        // An object is queued once, when its shared count first goes negative, it may have been merged since (when its
+        // biased count dropped to zero), but not disposed.
+        for ( shared_block_base * b : queue_ )
+            if ( b->merge ( true ) )
+                b->dispose ( );
+    }
+};
+
+bool shared_block_base::is_biased ( ) const noexcept {
+    return owner == brc_owner::current and not( shared.load ( std::memory_order_relaxed ) & merged );
+}
+
+void shared_block_base::release ( ) noexcept {
+    if ( is_biased ( ) ) {
+        if ( not --biased and merge ( ) )
+            dispose ( );
+        return;
+    }
+    // The decrement and the queued flag in one step, the object can not be disposed before it is in the queue.
+    std::intptr_t prior = shared.load ( std::memory_order_relaxed ), next;
+    do {
+        next = prior - one;
+        if ( not( prior & ( merged | queued ) ) and ( next >> 2 ) < 0 )
+            next |= queued;
+    } while ( not shared.compare_exchange_weak ( prior, next, std::memory_order_acq_rel, std::memory_order_relaxed ) );
+    if ( ( next & queued ) and not( prior & queued ) )
+        owner->enqueue ( this );
+    else if ( ( next & merged ) and not( next & queued ) and not( next >> 2 ) )
+        dispose ( );
+}
+
+void shared_block_base::dispose ( ) noexcept {
+    brc_owner * const o = owner;
+    destroy ( this );
+    o->unref ( );
+}
+
+template<typename T>
+struct shared_block : shared_block_base {
+    T value;
+
+    template<typename... Args>
+    shared_block ( void ( *destroy_ ) ( shared_block_base * ) noexcept, Args &&... args_ ) :
+        shared_block_base ( brc_owner::local ( ), destroy_ ), value ( std::forward<Args> ( args_ )... ) {
+        owner->ref ( );
+    }
+};
+
+// The block of a shared_offset_ptr, with the pool it came from.
+template<typename T>
+struct shared_pool_block : shared_block<T> {
+    offset_pool<shared_pool_block> * const pool;
+
+    template<typename... Args>
+    shared_pool_block ( offset_pool<shared_pool_block> * pool_, void ( *destroy_ ) ( shared_block_base * ) noexcept,
+                        Args &&... args_ ) :
+        shared_block<T> ( destroy_, std::forward<Args> ( args_ )... ),
+        pool ( pool_ ) {}
+};
+
+template<typename T, bool Compact>
+class basic_shared_ptr {
+
+    public:
+    using element_type    = T;
+    using pointer         = element_type *;
+    using reference       = element_type &;
+    using block_type      = std::conditional_t<Compact, shared_pool_block<T>, shared_block<T>>;
+    using offset_ptr_type = offset_ptr<block_type, heap_offset_ptr_pointer>;
+    using data_type       = std::conditional_t<Compact, typename offset_ptr_type::offset_type, block_type *>;
+
+    basic_shared_ptr ( ) noexcept = default;
+    basic_shared_ptr ( std::nullptr_t ) noexcept {}
+
+    basic_shared_ptr ( basic_shared_ptr const & other_ ) noexcept : m_data ( other_.m_data ) {
+        if ( block_type * b = block ( ) )
+            b->retain ( );
+    }
+    basic_shared_ptr ( basic_shared_ptr && moving_ ) noexcept : m_data ( std::exchange ( moving_.m_data, data_type{ } ) ) {}
+
+    ~basic_shared_ptr ( ) noexcept {
+        if ( block_type * b = block ( ) )
+            b->release ( );
+    }
+
+    basic_shared_ptr & operator= ( basic_shared_ptr const & other_ ) noexcept {
+        basic_shared_ptr ( other_ ).swap ( *this );
+        return *this;
+    }
+    basic_shared_ptr & operator= ( basic_shared_ptr && moving_ ) noexcept {
+        basic_shared_ptr ( std::move ( moving_ ) ).swap ( *this );
+        return *this;
+    }
+    basic_shared_ptr & operator= ( std::nullptr_t ) noexcept {
+        reset ( );
+        return *this;
+    }
+
+    // Observers.
+
+    [[nodiscard]] pointer get ( ) const noexcept {
+        block_type * b = block ( );
+        return b ? std::addressof ( b->value ) : nullptr;
+    }
+    [[nodiscard]] pointer operator-> ( ) const noexcept { return get ( ); }
+    [[nodiscard]] reference operator* ( ) const noexcept { return *get ( ); }
+    [[nodiscard]] explicit operator bool ( ) const noexcept { return m_data != data_type{ }; }
+
+    [[nodiscard]] data_type raw ( ) const noexcept { return m_data; }
+
+    // Modifiers.
+
+    void reset ( ) noexcept { basic_shared_ptr ( ).swap ( *this ); }
+    void swap ( basic_shared_ptr & other_ ) noexcept { std::swap ( m_data, other_.m_data ); }
+
+    template<typename U, bool C, typename... Args>
+    friend basic_shared_ptr<U, C> make_basic_shared ( Args &&... args_ );
+
+    private:
+    data_type m_data = { };
+
+    explicit basic_shared_ptr ( block_type * b_ ) noexcept {
+        if constexpr ( Compact )
+            m_data = offset_ptr_type::offset_from_ptr ( b_ );
+        else
+            m_data = b_;
+    }
+
+    [[nodiscard]] block_type * block ( ) const noexcept {
+        if constexpr ( Compact )
+            return m_data ? offset_ptr_type::ptr_from_offset ( m_data ) : nullptr;
+        else
+            return m_data;
+    }
+
+    static void destroy ( shared_block_base * b_ ) noexcept {
+        block_type * const b = static_cast<block_type *> ( b_ );
+        if constexpr ( Compact ) {
+            offset_pool<block_type> * const pool = b->pool;
+            assert ( pool->contains ( b ) );
+            std::destroy_at ( b );
+            // A pool is installed on the thread that built it only.
+            if ( pool == offset_pool<block_type>::installed ( ) )
+                pool->deallocate ( b );
+            else
+                pool->deallocate_remote ( b );
+        }
+        else {
+            delete b;
+        }
+    }
+};
+
+template<typename T, bool Compact, typename... Args>
+[[nodiscard]] basic_shared_ptr<T, Compact> make_basic_shared ( Args &&... args_ ) {
+    using pointer    = basic_shared_ptr<T, Compact>;
+    using block_type = typename pointer::block_type;
+    if ( brc_owner * owner = brc_owner::current )
+        owner->drain ( );
+    if constexpr ( Compact ) {
+        // A heap allocation would not, in general, be addressable by a 16-bit offset.
+        offset_pool<block_type> * pool = offset_pool<block_type>::installed ( );
+        if ( not pool )
+            throw std::runtime_error ( "make_shared_offset: no shared_offset_pool installed" );
+        void * p = pool->allocate ( );
+        if ( not p )
+            throw std::bad_alloc ( );
+        try {
+            return pointer ( ::new ( p ) block_type ( pool, &pointer::destroy, std::forward<Args> ( args_ )... ) );
+        }
+        catch ( ... ) {
+            pool->deallocate ( p );
+            throw;
+        }
+    }
+    else {
+        return pointer ( new block_type ( &pointer::destroy, std::forward<Args> ( args_ )... ) );
+    }
+}
+
+} // namespace detail
+
+template<typename T>
+using shared_ptr = detail::basic_shared_ptr<T, false>;
+
+template<typename T>
+using shared_offset_ptr = detail::basic_shared_ptr<T, true>;
+
+// The pool that make_shared_offset<T> allocates from, when installed.
+template<typename T>
+using shared_offset_pool = offset_pool<detail::shared_pool_block<T>>;
+
+// Installs the base of pool_ on another thread (until destruction), so that the shared_offset_ptr<T>'s into the pool
+// can be copied and released there, the pool must outlive it.
+template<typename T>
+class shared_offset_pool_attachment {
+
+    public:
+    explicit shared_offset_pool_attachment ( shared_offset_pool<T> const & pool_ ) noexcept :
+        m_previous ( std::exchange ( base_type::ptr, pool_.data ( ) ) ) {}
+
+    shared_offset_pool_attachment ( shared_offset_pool_attachment const & ) = delete;
+    shared_offset_pool_attachment & operator= ( shared_offset_pool_attachment const & ) = delete;
+
+    ~shared_offset_pool_attachment ( ) noexcept { base_type::ptr = m_previous; }
+
+    private:
+    using base_type = detail::offset_ptr_base<detail::shared_pool_block<T>, detail::heap_offset_ptr_pointer>;
+
+    detail::shared_pool_block<T> * m_previous;
+};
+
+template<typename T, typename... Args>
+[[nodiscard]] shared_ptr<T> make_shared ( Args &&... args_ ) {
+    return detail::make_basic_shared<T, false> ( std::forward<Args> ( args_ )... );
+}
+
+template<typename T, typename... Args>
+[[nodiscard]] shared_offset_ptr<T> make_shared_offset ( Args &&... args_ ) {
+    return detail::make_basic_shared<T, true> ( std::forward<Args> ( args_ )... );
+}
+
+// Merge the objects of this thread that were released on other threads (make_shared does so as well).
+inline void merge_shared ( ) noexcept {
+    if ( detail::brc_owner * owner = detail::brc_owner::current )
+        owner->drain ( );
+}
+
+template<typename T, bool Compact>
+struct is_trivially_relocatable<detail::basic_shared_ptr<T, Compact>> : std::true_type {};
+
+} // namespace sax
+
+namespace std {
+template<typename T, bool Compact>
+void swap ( sax::detail::basic_shared_ptr<T, Compact> & lhs, sax::detail::basic_shared_ptr<T, Compact> & rhs ) noexcept {
+    lhs.swap ( rhs );
+}
+} // namespace std
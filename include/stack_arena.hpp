@@ -0,0 +1,112 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "offset_ptr.hpp"
+
+namespace sax {
+
+// A bump arena for the temporaries of one request, declared as a local, so that it lives on the stack, close to its
+// top, where stack_offset_ptr<Type> reaches. The objects are destroyed (in reverse order of construction) when the
+// arena goes out of scope, or on clear. Stack offsets are in units of Type counted from the top of the stack, so the
+// slots are placed on that grid, one slot of the storage is spent on the alignment.
+
+template<typename Type, std::size_t Capacity>
+class stack_arena {
+
+    public:
+    using value_type    = Type;
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using size_type       = std::size_t;
+    using offset_ptr_type = stack_offset_ptr<Type>;
+    using offset_type     = typename offset_ptr_type::offset_type;
+
+    static_assert ( Capacity > 0, "the capacity must be positive" );
+
+    stack_arena ( ) : m_first ( first_slot ( ) ) {
+        std::uintptr_t const top   = reinterpret_cast<std::uintptr_t> ( offset_ptr_type::base_ptr ( ) );
+        std::uintptr_t const first = reinterpret_cast<std::uintptr_t> ( m_first );
+        if ( first >= top or ( top - first ) / sizeof ( value_type ) > offset_type ( ~0 ) or
+             first + Capacity * sizeof ( value_type ) > top )
+            throw std::runtime_error ( "stack_arena: the arena is not addressable from the top of the stack" );
+    }
+
+    stack_arena ( stack_arena const & ) = delete;
+    stack_arena & operator= ( stack_arena const & ) = delete;
+
+    ~stack_arena ( ) noexcept { clear ( ); }
+
+    // Allocation.
+
+    template<typename... Args>
+    [[nodiscard]] offset_ptr_type construct ( Args &&... args_ ) {
+        if ( m_size == Capacity )
+            throw std::bad_alloc ( );
+        pointer p = ::new ( static_cast<void *> ( m_first + m_size ) ) value_type ( std::forward<Args> ( args_ )... );
+        ++m_size;
+        return offset_ptr_type ( p );
+    }
+
+    // Destroy all objects, the arena can be reused.
+    void clear ( ) noexcept {
+        if constexpr ( not std::is_trivially_destructible<value_type>::value ) {
+            while ( m_size )
+                std::destroy_at ( m_first + --m_size );
+        }
+        m_size = 0;
+    }
+
+    // Observers.
+
+    [[nodiscard]] size_type size ( ) const noexcept { return m_size; }
+    [[nodiscard]] static constexpr size_type capacity ( ) noexcept { return Capacity; }
+
+    [[nodiscard]] pointer data ( ) const noexcept { return m_first; }
+    [[nodiscard]] bool contains ( const_pointer p_ ) const noexcept { return m_first <= p_ and p_ < m_first + m_size; }
+
+    private:
+    alignas ( value_type ) unsigned char m_storage[ ( Capacity + 1 ) * sizeof ( value_type ) ];
+    pointer m_first;
+    size_type m_size = 0;
+
+    // The first slot of the storage that is a whole number of Type's below the top of the stack.
+    [[nodiscard]] pointer first_slot ( ) noexcept {
+        std::uintptr_t const top   = reinterpret_cast<std::uintptr_t> ( offset_ptr_type::base_ptr ( ) );
+        std::uintptr_t const begin = reinterpret_cast<std::uintptr_t> ( m_storage );
+        return reinterpret_cast<pointer> ( m_storage + ( top - begin ) % sizeof ( value_type ) );
+    }
+};
+
+} // namespace sax
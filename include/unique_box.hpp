@@ -0,0 +1,187 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "offset_ptr.hpp"
+
+namespace sax {
+
+// A unique_ptr, that stores objects of up to InlineBytes inline, instead of on the heap. Objects that are larger,
+// over-aligned or can throw on move, and objects adopted from a (possibly derived) pointer, live on the heap. The
+// pointer word holds the heap pointer as is (a pointer to a base subobject need not be aligned beyond its type), or,
+// in inline mode, the tag 2, which is never the address of an object. The box moves the inline object on move.
+
+template<typename T, std::size_t InlineBytes = 3 * sizeof ( void * )>
+class unique_box {
+
+    public:
+    using value_type    = T;
+    using pointer       = value_type *;
+    using const_pointer = value_type const *;
+
+    using reference       = value_type &;
+    using const_reference = value_type const &;
+
+    static constexpr bool fits_inline = sizeof ( value_type ) <= InlineBytes and
+                                        alignof ( value_type ) <= alignof ( std::max_align_t ) and
+                                        std::is_nothrow_move_constructible<value_type>::value;
+
+    unique_box ( ) noexcept : m_data ( 0 ) {}
+    unique_box ( std::nullptr_t ) noexcept : m_data ( 0 ) {}
+
+    // Adopt raw_, always on the heap.
+    explicit unique_box ( pointer raw_ ) noexcept : m_data ( reinterpret_cast<std::uintptr_t> ( raw_ ) ) {}
+
+    // Construct the object in place, inline if it fits.
+    template<typename... Args>
+    explicit unique_box ( std::in_place_t, Args &&... args_ ) {
+        if constexpr ( fits_inline ) {
+            ::new ( static_cast<void *> ( m_storage ) ) value_type ( std::forward<Args> ( args_ )... );
+            m_data = inline_tag;
+        }
+        else {
+            m_data = reinterpret_cast<std::uintptr_t> ( new value_type ( std::forward<Args> ( args_ )... ) );
+        }
+    }
+
+    // Take over from a unique_ptr to (a type derived from) T, on the heap, the box deletes, so the source must as well.
+    template<typename U>
+    explicit unique_box ( unique_ptr<U, immediate_delete> && moving_ ) noexcept :
+        m_data ( reinterpret_cast<std::uintptr_t> ( static_cast<pointer> ( moving_.release ( ) ) ) ) {}
+
+    unique_box ( unique_box && moving_ ) noexcept : m_data ( 0 ) { take ( moving_ ); }
+
+    unique_box ( unique_box const & ) = delete;
+
+    ~unique_box ( ) noexcept { destroy ( ); }
+
+    unique_box & operator= ( unique_box && moving_ ) noexcept {
+        if ( this != std::addressof ( moving_ ) ) {
+            destroy ( );
+            m_data = 0;
+            take ( moving_ );
+        }
+        return *this;
+    }
+    unique_box & operator= ( std::nullptr_t ) noexcept {
+        reset ( );
+        return *this;
+    }
+
+    unique_box & operator= ( unique_box const & ) = delete;
+
+    // Access.
+
+    [[nodiscard]] pointer get ( ) const noexcept {
+        return is_inline ( ) ? reinterpret_cast<pointer> ( const_cast<unsigned char *> ( m_storage ) )
+                             : reinterpret_cast<pointer> ( m_data );
+    }
+
+    pointer operator-> ( ) const noexcept { return get ( ); }
+    reference operator* ( ) const noexcept { return *get ( ); }
+
+    explicit operator bool ( ) const noexcept { return m_data; }
+
+    [[nodiscard]] bool is_inline ( ) const noexcept { return inline_tag == m_data; }
+
+    // Modifiers.
+
+    // Hands over a heap object, an inline object is moved to the heap first.
+    [[nodiscard]] pointer release ( ) {
+        if ( is_inline ( ) ) {
+            pointer p = new value_type ( std::move ( *get ( ) ) );
+            destroy ( );
+            m_data = 0;
+            return p;
+        }
+        return reinterpret_cast<pointer> ( std::exchange ( m_data, 0 ) );
+    }
+
+    void reset ( pointer p_ = pointer ( ) ) noexcept {
+        destroy ( );
+        m_data = reinterpret_cast<std::uintptr_t> ( p_ );
+    }
+
+    void swap ( unique_box & other_ ) noexcept {
+        unique_box tmp ( std::move ( other_ ) );
+        other_ = std::move ( *this );
+        *this  = std::move ( tmp );
+    }
+
+    private:
+    std::uintptr_t m_data;
+    alignas ( fits_inline ? alignof ( value_type ) : 1 ) unsigned char m_storage[ fits_inline ? InlineBytes : 1 ];
+
+    static constexpr std::uintptr_t inline_tag = 0x0000'0000'0000'0002;
+
+    void destroy ( ) noexcept {
+        if ( is_inline ( ) ) {
+            if constexpr ( fits_inline )
+                std::destroy_at ( get ( ) );
+        }
+        else {
+            delete reinterpret_cast<pointer> ( m_data );
+        }
+    }
+
+    // Steal from an empty-able moving_, this is empty.
+    void take ( unique_box & moving_ ) noexcept {
+        if constexpr ( fits_inline ) {
+            if ( moving_.is_inline ( ) ) {
+                if constexpr ( is_trivially_relocatable_v<value_type> ) {
+                    std::memcpy ( m_storage, moving_.m_storage, sizeof ( value_type ) );
+                }
+                else {
+                    ::new ( static_cast<void *> ( m_storage ) ) value_type ( std::move ( *moving_.get ( ) ) );
+                    std::destroy_at ( moving_.get ( ) );
+                }
+                m_data         = inline_tag;
+                moving_.m_data = 0;
+                return;
+            }
+        }
+        m_data = std::exchange ( moving_.m_data, 0 );
+    }
+};
+
+template<typename T, std::size_t InlineBytes>
+struct is_trivially_relocatable<unique_box<T, InlineBytes>>
+    : std::integral_constant<bool, is_trivially_relocatable_v<T> or not unique_box<T, InlineBytes>::fits_inline> {};
+
+template<typename T, std::size_t InlineBytes = 3 * sizeof ( void * ), typename... Args>
+[[nodiscard]] unique_box<T, InlineBytes> make_box ( Args &&... args_ ) {
+    return unique_box<T, InlineBytes> ( std::in_place, std::forward<Args> ( args_ )... );
+}
+
+} // namespace sax
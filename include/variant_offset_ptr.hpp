@@ -0,0 +1,245 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "offset_ptr.hpp"
+
+namespace sax {
+
+namespace detail {
+// The index of T in Types, or ~0.
+template<typename T, typename... Types>
+[[nodiscard]] constexpr std::size_t index_of ( ) noexcept {
+    constexpr bool match[] = { std::is_same<T, Types>::value... };
+    for ( std::size_t i = 0; i < sizeof... ( Types ); ++i )
+        if ( match[ i ] )
+            return i;
+    return std::size_t ( ~0 );
+}
+} // namespace detail
+
+// An owning heap_offset_ptr to one of Types, in the same 2 bytes. The index of the alternative lives in the top bits,
+// the offset (relative to the base of that alternative) in the remaining low bits, so with more than 2 alternatives
+// the addressable range per alternative shrinks (14 bits up to 4 alternatives, 13 up to 8, 12 up to 16). Dispatch is
+// a switch on the index, the pointees need no vtable.
+
+template<typename... Types>
+class variant_offset_ptr {
+
+    static_assert ( sizeof... ( Types ) > 0 and sizeof... ( Types ) <= 16, "between 1 and 16 alternatives are supported" );
+
+    public:
+    using offset_type = std::uint16_t;
+    using size_type   = std::size_t;
+
+    template<size_type I>
+    using alternative = std::tuple_element_t<I, std::tuple<Types...>>;
+
+    template<typename T>
+    using offset_ptr_type = heap_offset_ptr<T>;
+
+    static constexpr size_type alternatives = sizeof... ( Types );
+    static constexpr size_type npos         = size_type ( ~0 );
+
+    template<typename T>
+    static constexpr size_type index_of = detail::index_of<T, Types...> ( );
+
+    // Constructors.
+
+    variant_offset_ptr ( ) noexcept = default;
+    variant_offset_ptr ( std::nullptr_t ) noexcept {}
+
+    variant_offset_ptr ( variant_offset_ptr const & ) = delete;
+    variant_offset_ptr ( variant_offset_ptr && moving_ ) noexcept : m_data ( std::exchange ( moving_.m_data, offset_type{ 0 } ) ) {}
+
+    // Takes ownership of the pointee of moving_, which must own it (not be weak), and be in range.
+    template<typename T>
+    variant_offset_ptr ( offset_ptr_type<T> && moving_ ) {
+        static_assert ( index_of<T> != npos, "T is not an alternative" );
+        if ( moving_.is_weak ( ) )
+            throw std::runtime_error ( "variant_offset_ptr: a weak pointer does not own its pointee" );
+        offset_type const o = offset_ptr_type<T>::offset_view ( moving_.raw_offset ( ) );
+        if ( o > offset_mask )
+            throw std::runtime_error ( "variant_offset_ptr: pointer out of range" );
+        (void) moving_.release ( );
+        m_data = encode ( index_of<T>, o );
+    }
+
+    ~variant_offset_ptr ( ) noexcept { reset ( ); }
+
+    // Assignment.
+
+    variant_offset_ptr & operator= ( variant_offset_ptr const & ) = delete;
+
+    variant_offset_ptr & operator= ( variant_offset_ptr && moving_ ) noexcept {
+        variant_offset_ptr ( std::move ( moving_ ) ).swap ( *this );
+        return *this;
+    }
+
+    variant_offset_ptr & operator= ( std::nullptr_t ) noexcept {
+        reset ( );
+        return *this;
+    }
+
+    // Observers.
+
+    // The index of the alternative, 0 for null.
+    [[nodiscard]] size_type index ( ) const noexcept { return index_of_data ( m_data ); }
+
+    [[nodiscard]] explicit operator bool ( ) const noexcept { return offset_of_data ( m_data ); }
+
+    template<typename T>
+    [[nodiscard]] bool holds ( ) const noexcept {
+        return index ( ) == index_of<T> and *this;
+    }
+
+    template<size_type I>
+    [[nodiscard]] alternative<I> * get ( ) const noexcept {
+        offset_type const o = offset_of_data ( m_data );
+        return o ? offset_ptr_type<alternative<I>>::get ( o ) : nullptr;
+    }
+
+    template<typename T>
+    [[nodiscard]] T * get_if ( ) const noexcept {
+        return holds<T> ( ) ? get<index_of<T>> ( ) : nullptr;
+    }
+
+    [[nodiscard]] offset_type raw_offset ( ) const noexcept { return m_data; }
+
+    // Visit.
+
+    // Call visitor_ with a pointer to the active alternative (a null pointer to alternative 0 if this is null), all
+    // overloads must return the same type.
+    template<typename Visitor>
+    decltype ( auto ) visit ( Visitor && visitor_ ) const {
+        switch ( index ( ) ) {
+            case 0: return invoke<0> ( visitor_ );
+            case 1: return invoke<1> ( visitor_ );
+            case 2: return invoke<2> ( visitor_ );
+            case 3: return invoke<3> ( visitor_ );
+            case 4: return invoke<4> ( visitor_ );
+            case 5: return invoke<5> ( visitor_ );
+            case 6: return invoke<6> ( visitor_ );
+            case 7: return invoke<7> ( visitor_ );
+            case 8: return invoke<8> ( visitor_ );
+            case 9: return invoke<9> ( visitor_ );
+            case 10: return invoke<10> ( visitor_ );
+            case 11: return invoke<11> ( visitor_ );
+            case 12: return invoke<12> ( visitor_ );
+            case 13: return invoke<13> ( visitor_ );
+            case 14: return invoke<14> ( visitor_ );
+            default: return invoke<15> ( visitor_ );
+        }
+    }
+
+    // Visit the n_ non-null pointers of first_, grouped by alternative (in the order of Types, and in the order of
+    // first_ within an alternative). The offsets are bucketed first, each bucket is then visited in a loop that is
+    // specific to its alternative, instead of dispatching (and mispredicting) per element.
+    template<typename Visitor>
+    static void visit_sorted ( variant_offset_ptr const * first_, size_type n_, Visitor && visitor_ ) {
+        std::array<size_type, alternatives + 1> begin = { };
+        for ( size_type i = 0; i < n_; ++i )
+            begin[ index_of_data ( first_[ i ].m_data ) + 1 ] += offset_of_data ( first_[ i ].m_data ) != 0;
+        for ( size_type i = 1; i <= alternatives; ++i )
+            begin[ i ] += begin[ i - 1 ];
+        std::vector<offset_type> bucket ( begin[ alternatives ] );
+        std::array<size_type, alternatives + 1> end = begin;
+        for ( size_type i = 0; i < n_; ++i )
+            if ( offset_type const o = offset_of_data ( first_[ i ].m_data ); o )
+                bucket[ end[ index_of_data ( first_[ i ].m_data ) ]++ ] = o;
+        visit_buckets ( bucket.data ( ), begin, visitor_, std::make_index_sequence<alternatives> ( ) );
+    }
+
+    // Modifiers.
+
+    void reset ( ) noexcept {
+        if ( offset_of_data ( m_data ) )
+            visit ( [] ( auto * p_ ) noexcept {
+                offset_ptr_type<std::remove_pointer_t<decltype ( p_ )>> owner ( p_ ); // Disposes of p_.
+            } );
+        m_data = 0;
+    }
+
+    void swap ( variant_offset_ptr & other_ ) noexcept { std::swap ( m_data, other_.m_data ); }
+
+    private:
+    static constexpr size_type index_bits = alternatives <= 1 ? 0 : alternatives <= 2 ? 1 : alternatives <= 4 ? 2 : alternatives <= 8 ? 3 : 4;
+    static constexpr size_type index_shift = sizeof ( offset_type ) * 8 - index_bits;
+    // The weak bit of heap_offset_ptr is never set on an owned pointer, so at most 15 bits are used for the offset.
+    static constexpr offset_type offset_mask =
+        static_cast<offset_type> ( ( 1u << ( index_shift < 15 ? index_shift : 15 ) ) - 1 );
+
+    offset_type m_data = 0;
+
+    [[nodiscard]] static constexpr offset_type encode ( size_type i_, offset_type o_ ) noexcept {
+        return static_cast<offset_type> ( ( index_bits ? i_ << index_shift : 0 ) | o_ );
+    }
+    [[nodiscard]] static constexpr size_type index_of_data ( offset_type d_ ) noexcept {
+        return index_bits ? d_ >> index_shift : 0;
+    }
+    [[nodiscard]] static constexpr offset_type offset_of_data ( offset_type d_ ) noexcept { return d_ & offset_mask; }
+
+    // The cases beyond the last alternative are unreachable, they forward to alternative 0 to keep the return type.
+    template<size_type I, typename Visitor>
+    decltype ( auto ) invoke ( Visitor & visitor_ ) const {
+        if constexpr ( I < alternatives )
+            return visitor_ ( get<I> ( ) );
+        else
+            return visitor_ ( get<0> ( ) );
+    }
+
+    template<typename Visitor, size_type... I>
+    static void visit_buckets ( offset_type const * bucket_, std::array<size_type, alternatives + 1> const & begin_,
+                                Visitor & visitor_, std::index_sequence<I...> ) {
+        ( visit_bucket<I> ( bucket_ + begin_[ I ], bucket_ + begin_[ I + 1 ], visitor_ ), ... );
+    }
+
+    template<size_type I, typename Visitor>
+    static void visit_bucket ( offset_type const * first_, offset_type const * last_, Visitor & visitor_ ) {
+        for ( ; first_ != last_; ++first_ )
+            visitor_ ( offset_ptr_type<alternative<I>>::get ( *first_ ) );
+    }
+};
+
+template<typename... Types>
+struct is_trivially_relocatable<variant_offset_ptr<Types...>> : std::true_type {};
+
+} // namespace sax
+
+namespace std {
+template<typename... Types>
+void swap ( sax::variant_offset_ptr<Types...> & lhs, sax::variant_offset_ptr<Types...> & rhs ) noexcept {
+    lhs.swap ( rhs );
+}
+} // namespace std
@@ -0,0 +1,232 @@
+
+// MIT License
+//
+// Copyright (c) 2020 degski
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "offset_ptr.hpp"
+
+// Weak handles, an index and a generation, into a per type slot table, shared by all threads. The owning pointers
+// (unique_ptr or heap_offset_ptr, with the sax::generational_delete policy) bump the generation of the slot of an
+// object when they free (or release) it, on whichever thread, so a handle is checked in O(1), by comparing
+// generations, with acquire loads only (no lock, no read-modify-write), and without keeping the object alive.
+//
+// Handles are taken of objects of a type T that derives from sax::enable_weak_handle<T>, which records the slot of the
+// object (if any). Freeing an object without handles costs a load of that, taking a handle, and freeing an object with
+// handles, lock the table. As with a raw pointer, the object must not be freed while the result of lock is in use.
+
+namespace sax {
+
+template<typename T>
+class slot_table;
+
+// The base of the objects that handles can be taken of, struct node : sax::enable_weak_handle<node> { ... }. The slot
+// belongs to the object, it is not copied with its value.
+template<typename T>
+class enable_weak_handle {
+
+    protected:
+    enable_weak_handle ( ) noexcept = default;
+    enable_weak_handle ( enable_weak_handle const & ) noexcept {}
+    enable_weak_handle & operator= ( enable_weak_handle const & ) noexcept { return *this; }
+    ~enable_weak_handle ( ) = default;
+
+    private:
+    friend class slot_table<T>;
+
+    mutable std::atomic<std::uint32_t> m_slot = { 0 }; // The slot plus one, 0 if the object has no handles.
+};
+
+template<typename T>
+struct weak_handle {
+
+    std::uint32_t index      = 0;
+    std::uint32_t generation = 0; // Never a live generation, the default handle is expired.
+
+    // The object, or nullptr if it has been freed.
+    [[nodiscard]] T * lock ( ) const noexcept { return slot_table<T>::instance ( ).lock ( *this ); }
+    [[nodiscard]] bool expired ( ) const noexcept { return not lock ( ); }
+
+    [[nodiscard]] friend bool operator== ( weak_handle const & a_, weak_handle const & b_ ) noexcept {
+        return a_.index == b_.index and a_.generation == b_.generation;
+    }
+    [[nodiscard]] friend bool operator!= ( weak_handle const & a_, weak_handle const & b_ ) noexcept { return not( a_ == b_ ); }
+};
+
+template<typename T>
+class slot_table {
+
+    public:
+    using size_type = std::size_t;
+
+    // The slots are allocated in chunks that never move, so that lock can read them while the table grows.
+    static constexpr size_type chunk_size = 4'096, max_chunks = 4'096;
+
+    // Never destroyed, objects can be freed during static destruction.
+    [[nodiscard]] static slot_table & instance ( ) noexcept {
+        static slot_table * const table = new slot_table;
+        return *table;
+    }
+
+    // The handle of p_, which occupies a slot from now until it is retired.
+    [[nodiscard]] weak_handle<T> handle ( T * p_ ) {
+        if ( not p_ )
+            return { };
+        std::atomic<std::uint32_t> & recorded = slot_of ( p_ );
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        std::uint32_t i = recorded.load ( std::memory_order_relaxed );
+        if ( i ) {
+            --i;
+        }
+        else {
+            if ( m_free.empty ( ) ) {
+                m_free.reserve ( m_top + 1 ); // Retire does not allocate.
+                i = grow ( );
+            }
+            else {
+                i = m_free.back ( );
+                m_free.pop_back ( );
+            }
+            at ( i ).object.store ( p_, std::memory_order_release );
+            recorded.store ( i + 1, std::memory_order_relaxed );
+            m_handled.fetch_add ( 1, std::memory_order_relaxed );
+        }
+        return { i, at ( i ).generation.load ( std::memory_order_relaxed ) };
+    }
+
+    // The generation is checked again after loading the object, in case the slot was reused in between.
+    [[nodiscard]] T * lock ( weak_handle<T> const & h_ ) const noexcept {
+        slot const * chunk =
+            h_.index < chunk_size * max_chunks ? m_chunks[ h_.index / chunk_size ].load ( std::memory_order_acquire ) : nullptr;
+        if ( not chunk )
+            return nullptr;
+        slot const & s = chunk[ h_.index % chunk_size ];
+        if ( s.generation.load ( std::memory_order_acquire ) != h_.generation )
+            return nullptr;
+        T * const p = s.object.load ( std::memory_order_acquire );
+        return s.generation.load ( std::memory_order_acquire ) == h_.generation ? p : nullptr;
+    }
+
+    // Expire the handles of p_ (if any), called by the owner that frees (or releases) p_.
+    void retire ( T const * p_ ) noexcept {
+        if ( not p_ )
+            return;
+        std::atomic<std::uint32_t> & recorded = slot_of ( p_ );
+        if ( not recorded.load ( std::memory_order_relaxed ) )
+            return;
+        std::lock_guard<std::mutex> lock ( m_mutex );
+        std::uint32_t const i = recorded.load ( std::memory_order_relaxed ) - 1;
+        recorded.store ( 0, std::memory_order_relaxed );
+        slot & s              = at ( i );
+        std::uint32_t const g = s.generation.load ( std::memory_order_relaxed ) + 1;
+        s.generation.store ( g ? g : 1u, std::memory_order_release );
+        s.object.store ( nullptr, std::memory_order_release );
+        m_free.push_back ( i );
+        m_handled.fetch_sub ( 1, std::memory_order_relaxed );
+    }
+
+    // The number of objects that occupy a slot.
+    [[nodiscard]] size_type size ( ) const noexcept { return m_handled.load ( std::memory_order_relaxed ); }
+
+    private:
+    struct slot {
+        std::atomic<T *> object               = { nullptr };
+        std::atomic<std::uint32_t> generation = { 1u };
+    };
+
+    std::array<std::atomic<slot *>, max_chunks> m_chunks = { };
+    std::atomic<size_type> m_handled                     = { 0 }; // The number of objects with handles.
+    std::mutex m_mutex;
+    // Guarded by m_mutex.
+    size_type m_top = 0;
+    std::vector<std::uint32_t> m_free;
+
+    slot_table ( ) noexcept = default;
+
+    [[nodiscard]] static std::atomic<std::uint32_t> & slot_of ( T const * p_ ) noexcept {
+        return static_cast<enable_weak_handle<T> const *> ( p_ )->m_slot;
+    }
+
+    [[nodiscard]] slot & at ( std::uint32_t i_ ) const noexcept {
+        return m_chunks[ i_ / chunk_size ].load ( std::memory_order_relaxed )[ i_ % chunk_size ];
+    }
+
+    [[nodiscard]] std::uint32_t grow ( ) {
+        size_type const chunk = m_top / chunk_size;
+        if ( chunk == max_chunks )
+            throw std::runtime_error ( "slot_table: too many objects with handles" );
+        if ( not( m_top % chunk_size ) )
+            m_chunks[ chunk ].store ( new slot[ chunk_size ], std::memory_order_release );
+        return static_cast<std::uint32_t> ( m_top++ );
+    }
+};
+
+// Expires the weak handles of an object, then hands it to DeletePolicy, e.g. unique_ptr<T, generational_delete<>>.
+template<typename DeletePolicy = immediate_delete>
+struct generational_delete {
+
+    // Only objects of a T that derives from enable_weak_handle<T> can have handles.
+    template<typename T>
+    static void retire ( T * p_ ) noexcept {
+        using type = std::remove_cv_t<T>;
+        if constexpr ( std::is_base_of<enable_weak_handle<type>, type>::value )
+            slot_table<type>::instance ( ).retire ( p_ );
+    }
+
+    template<typename T>
+    static void destroy ( T * p_ ) noexcept {
+        retire ( p_ );
+        DeletePolicy::destroy ( p_ );
+    }
+    template<typename T, typename Pool>
+    static void destroy ( T * p_, Pool & pool_ ) noexcept {
+        retire ( p_ );
+        DeletePolicy::destroy ( p_, pool_ );
+    }
+};
+
+template<typename T, typename DeletePolicy>
+[[nodiscard]] weak_handle<T> make_weak ( unique_ptr<T, DeletePolicy> const & p_ ) {
+    static_assert ( std::is_base_of<enable_weak_handle<T>, T>::value, "T must derive from sax::enable_weak_handle<T>" );
+    static_assert ( detail::has_retire<DeletePolicy, T>::value, "the owner must expire the handles, see sax::generational_delete" );
+    return slot_table<T>::instance ( ).handle ( p_.get ( ) );
+}
+
+template<typename T, typename DeletePolicy>
+[[nodiscard]] weak_handle<T> make_weak ( heap_offset_ptr<T, DeletePolicy> const & p_ ) {
+    static_assert ( std::is_base_of<enable_weak_handle<T>, T>::value, "T must derive from sax::enable_weak_handle<T>" );
+    static_assert ( detail::has_retire<DeletePolicy, T>::value, "the owner must expire the handles, see sax::generational_delete" );
+    return slot_table<T>::instance ( ).handle ( p_.get ( ) );
+}
+
+} // namespace sax
@@ -33,6 +33,7 @@
 #include <map>
 #include <random>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -40,6 +41,7 @@
 #include <sax/uniform_int_distribution.hpp>
 
 #include <offset_ptr.hpp>
+#include <shared_ptr.hpp>
 
 #include <sax/stl.hpp>
 
@@ -191,11 +193,36 @@ void handleEptr ( std::exception_ptr eptr ) { // Passing by value is ok.
     }
 }
 
+// An object queued on its owner (b released elsewhere), whose biased count then drops to zero, is only disposed by the
+// merge of the queue.
+void brc_queued_then_released ( ) {
+    struct counted {
+        int & live;
+        explicit counted ( int & live_ ) noexcept : live ( live_ ) { ++live; }
+        ~counted ( ) noexcept { --live; }
+    };
+    int live = 0;
+    auto a   = sax::make_shared<counted> ( live );
+    auto b = a, c = a;
+    sax::shared_ptr<counted> d;
+    std::thread ( [ & ] {
+        b.reset ( );
+        d = c;
+    } ).join ( );
+    a.reset ( );
+    c.reset ( );
+    d.reset ( );
+    assert ( live == 1 );
+    sax::merge_shared ( );
+    assert ( live == 0 );
+}
+
 int main ( ) {
 
     std::exception_ptr eptr;
 
     try {
+        brc_queued_then_released ( );
     }
     catch ( ... ) {
         eptr = std::current_exception ( ); // Capture.